@@ -0,0 +1,405 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <stdexcept>
+#include <type_traits>
+
+#include "graph.hpp"
+#include "types.hpp"
+#include "layout.hpp"
+#include "svg.hpp"
+#include "raster.hpp"
+#include "mapped_parser.hpp"
+
+/**
+ * Binary format for caching a graph and optionally its finished layout.
+ *
+ * The file consists of the header followed by these sections, each aligned to 8 bytes:
+ *     attributes attrs                           the attributes of the layout
+ *     uint32_t  out_offsets[vertex_count + 1]   the edges in CSR format
+ *     uint32_t  out_targets[edge_count]
+ *     uint32_t  label_offsets[vertex_count + 1] offsets of labels in the string table
+ *     char      labels[label_bytes]             the string table
+ *     node      nodes[node_count]               only if the layout is present
+ *     flat_path paths[path_count]
+ *     vec2      points[point_count]
+ *
+ * The structures are stored in the native representation, so the cache can be only read
+ * on the same platform where it was written. The header records the sizes of the structures to detect a mismatch.
+ */
+struct binary_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t has_layout;
+
+    uint32_t vertex_count;
+    uint32_t edge_count;
+    uint64_t label_bytes;
+
+    uint32_t node_count;
+    uint32_t path_count;
+    uint64_t point_count;
+    float width;
+    float height;
+    float font_size;
+
+    uint32_t node_struct_size;
+    uint32_t path_struct_size;
+    uint32_t attr_struct_size;
+};
+
+static_assert(std::is_trivially_copyable_v<node>, "node has to be stored directly");
+static_assert(std::is_trivially_copyable_v<flat_path>, "flat_path has to be stored directly");
+static_assert(std::is_trivially_copyable_v<attributes>, "attributes have to be stored directly");
+
+constexpr char binary_magic[8] = { 'D', 'E', 'M', 'E', 'K', 'G', 'R', 'F' };
+constexpr uint32_t binary_version = 2;
+
+inline std::size_t binary_align(std::size_t n) { return (n + 7) & ~std::size_t(7); }
+
+
+/**
+ * Graph and layout read from a memory mapped binary cache.
+ * All accessors return views into the mapping, so nothing is copied when loading.
+ */
+class binary_graph {
+    mapped_file file;
+    const binary_header* header = nullptr;
+    const attributes* attrs = nullptr;
+
+    const uint32_t* out_offsets = nullptr;
+    const uint32_t* out_targets = nullptr;
+    const uint32_t* label_offsets = nullptr;
+    const char* label_data = nullptr;
+
+    const node* node_data = nullptr;
+    const flat_path* path_data = nullptr;
+    const vec2* point_data = nullptr;
+
+public:
+    explicit binary_graph(const std::string& path) : file(path) {
+        std::string_view data = file.contents();
+        if (data.size() < sizeof(binary_header)) {
+            throw std::invalid_argument("'" + path + "' is not a graph cache.");
+        }
+        header = reinterpret_cast<const binary_header*>(data.data());
+        if (std::memcmp(header->magic, binary_magic, sizeof(binary_magic)) != 0 ||
+            header->version != binary_version ||
+            header->node_struct_size != sizeof(node) ||
+            header->path_struct_size != sizeof(flat_path) ||
+            header->attr_struct_size != sizeof(attributes))
+        {
+            throw std::invalid_argument("'" + path + "' is not a compatible graph cache.");
+        }
+
+        std::size_t offset = binary_align(sizeof(binary_header));
+        auto section = [&] (auto*& ptr, std::size_t count) {
+            using T = std::remove_const_t< std::remove_reference_t<decltype(*ptr)> >;
+            if (offset > data.size() || count > (data.size() - offset) / sizeof(T)) {
+                throw std::invalid_argument("'" + path + "' is truncated.");
+            }
+            ptr = reinterpret_cast<const T*>(data.data() + offset);
+            offset = binary_align(offset + count*sizeof(T));
+        };
+
+        section(attrs, 1);
+        section(out_offsets, header->vertex_count + 1);
+        section(out_targets, header->edge_count);
+        section(label_offsets, header->vertex_count + 1);
+        section(label_data, header->label_bytes);
+        if (header->has_layout) {
+            section(node_data, header->node_count);
+            section(path_data, header->path_count);
+            section(point_data, header->point_count);
+        }
+        validate(path);
+    }
+
+    unsigned size() const { return header->vertex_count; }
+    unsigned edge_count() const { return header->edge_count; }
+
+    const uint32_t* out_begin(vertex_t u) const { return out_targets + out_offsets[u]; }
+    const uint32_t* out_end(vertex_t u) const { return out_targets + out_offsets[u + 1]; }
+
+    std::string_view label(vertex_t u) const {
+        return { label_data + label_offsets[u], label_offsets[u + 1] - label_offsets[u] };
+    }
+
+    const attributes& attribs() const { return *attrs; }
+
+    bool has_layout() const { return header->has_layout; }
+    vec2 dimensions() const { return { header->width, header->height }; }
+    float font_size() const { return header->font_size; }
+
+    const node* nodes_begin() const { return node_data; }
+    const node* nodes_end() const { return node_data + header->node_count; }
+    const flat_path* paths_begin() const { return path_data; }
+    const flat_path* paths_end() const { return path_data + header->path_count; }
+    point_span points_of(const flat_path& p) const { return { point_data + p.offset, p.count }; }
+
+    /**
+     * Builds the graph for laying it out again.
+     */
+    graph to_graph() const {
+        std::vector< std::pair<vertex_t, vertex_t> > edges;
+        edges.reserve(edge_count());
+        for (vertex_t u = 0; u < size(); ++u) {
+            for (auto it = out_begin(u); it != out_end(u); ++it) {
+                edges.emplace_back(u, *it);
+            }
+        }
+        return graph(size(), edges);
+    }
+
+    /**
+     * Fills the labels as views into the mapping, which are valid while this object exists.
+     */
+    void get_labels(drawing_options& opts) const {
+        opts.label_views.resize(size());
+        for (vertex_t u = 0; u < size(); ++u) {
+            opts.label_views[u] = label(u);
+        }
+        opts.font_size = font_size();
+    }
+
+private:
+    /**
+     * Checks that all the offsets and identifiers stored in the file are within the bounds of the sections,
+     * so the accessors never read outside of the mapping.
+     */
+    void validate(const std::string& path) const {
+        auto check = [&path] (bool valid) {
+            if (!valid) {
+                throw std::invalid_argument("'" + path + "' is corrupted.");
+            }
+        };
+
+        check(out_offsets[0] == 0 && label_offsets[0] == 0);
+        for (vertex_t u = 0; u < size(); ++u) {
+            check(out_offsets[u] <= out_offsets[u + 1] && label_offsets[u] <= label_offsets[u + 1]);
+        }
+        check(out_offsets[size()] == edge_count() && label_offsets[size()] == header->label_bytes);
+        for (std::size_t i = 0; i < edge_count(); ++i) {
+            check(out_targets[i] < size());
+        }
+
+        if (!has_layout()) {
+            return;
+        }
+        for (auto it = nodes_begin(); it != nodes_end(); ++it) {
+            check(it->u < size());
+        }
+        for (auto it = paths_begin(); it != paths_end(); ++it) {
+            // the arrowheads are drawn from the last two points
+            check(uint64_t(it->offset) + it->count <= header->point_count && it->count >= 2);
+            check(it->from < header->node_count && it->to < header->node_count);
+        }
+    }
+};
+
+
+namespace detail {
+
+inline void pad_section(std::ofstream& out, std::size_t& offset) {
+    static const char zeros[8] = { 0 };
+    auto aligned = binary_align(offset);
+    out.write(zeros, aligned - offset);
+    offset = aligned;
+}
+
+template<typename T>
+void write_raw(std::ofstream& out, const T* data, std::size_t count, std::size_t& offset) {
+    out.write(reinterpret_cast<const char*>(data), count*sizeof(T));
+    offset += count*sizeof(T);
+}
+
+// writes the sequence of values produced by f(0), ..., f(count - 1) as one section
+template<typename T, typename F>
+void write_section(std::ofstream& out, std::size_t count, std::size_t& offset, F f) {
+    for (std::size_t i = 0; i < count; ++i) {
+        T val = f(i);
+        write_raw(out, &val, 1, offset);
+    }
+    pad_section(out, offset);
+}
+
+// writes the contents of a binary cache (see save_binary)
+void write_binary(std::ofstream& out,
+                  const graph& g,
+                  const attributes& attr,
+                  const drawing_options& opts,
+                  const sugiyama_layout* layout)
+{
+    auto get_label = [&opts] (vertex_t u) -> std::string_view {
+        if (u < opts.label_views.size()) {
+            return opts.label_views[u];
+        }
+        auto it = opts.labels.find(u);
+        return it == opts.labels.end() ? std::string_view() : std::string_view(it->second);
+    };
+
+    binary_header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, binary_magic, sizeof(binary_magic));
+    header.version = binary_version;
+    header.vertex_count = g.size();
+    header.font_size = opts.font_size;
+    header.node_struct_size = sizeof(node);
+    header.path_struct_size = sizeof(flat_path);
+    header.attr_struct_size = sizeof(attributes);
+    for (auto u : g.vertices()) {
+        header.edge_count += g.out_neighbours(u).size();
+        header.label_bytes += get_label(u).size();
+    }
+
+    if (layout) {
+        header.has_layout = 1;
+        header.width = layout->width();
+        header.height = layout->height();
+        header.node_count = layout->vertices().size();
+        header.path_count = layout->edges().size() + layout->flat_edges().size();
+        header.point_count = layout->flat_edges().points.size();
+        for (const auto& p : layout->edges()) {
+            header.point_count += p.points.size();
+        }
+    }
+
+    std::size_t offset = 0;
+    detail::write_raw(out, &header, 1, offset);
+    detail::pad_section(out, offset);
+    detail::write_raw(out, layout ? &layout->attribs() : &attr, 1, offset);
+    detail::pad_section(out, offset);
+
+    // edges
+    uint32_t sum = 0;
+    detail::write_section<uint32_t>(out, g.size() + 1, offset, [&] (std::size_t u) {
+        uint32_t start = sum;
+        if (u < g.size()) sum += g.out_neighbours(u).size();
+        return start;
+    });
+    for (auto u : g.vertices()) {
+        detail::write_raw(out, g.out_neighbours(u).data(), g.out_neighbours(u).size(), offset);
+    }
+    detail::pad_section(out, offset);
+
+    // labels
+    sum = 0;
+    detail::write_section<uint32_t>(out, g.size() + 1, offset, [&] (std::size_t u) {
+        uint32_t start = sum;
+        if (u < g.size()) sum += get_label(u).size();
+        return start;
+    });
+    for (auto u : g.vertices()) {
+        detail::write_raw(out, get_label(u).data(), get_label(u).size(), offset);
+    }
+    detail::pad_section(out, offset);
+
+    if (!layout) {
+        return;
+    }
+
+    detail::write_raw(out, layout->vertices().data(), layout->vertices().size(), offset);
+    detail::pad_section(out, offset);
+
+    // the paths are saved in the flat format regardless of the layout mode
+    const auto& paths = layout->edges();
+    const auto& flat = layout->flat_edges();
+    uint32_t point_offset = 0;
+    detail::write_section<flat_path>(out, header.path_count, offset, [&] (std::size_t i) {
+        if (i < paths.size()) {
+            flat_path p{ paths[i].from, paths[i].to, point_offset, static_cast<unsigned>(paths[i].points.size()),
+                         paths[i].bidirectional, paths[i].spline };
+            point_offset += p.count;
+            return p;
+        }
+        flat_path p = flat.paths[i - paths.size()];
+        p.offset += point_offset;
+        return p;
+    });
+
+    for (const auto& p : paths) {
+        detail::write_raw(out, p.points.data(), p.points.size(), offset);
+    }
+    detail::write_raw(out, flat.points.data(), flat.points.size(), offset);
+    detail::pad_section(out, offset);
+}
+
+} // namespace detail
+
+
+/**
+ * Saves the graph, its attributes, the labels from <opts> and optionally the layout of the graph.
+ * Vertices without a label are saved with an empty one.
+ * 
+ * The cache is written into a temporary file which is then renamed,
+ * so a failed write never leaves a partial cache behind.
+ */
+void save_binary(const std::string& file, 
+                 const graph& g, 
+                 const attributes& attr, 
+                 const drawing_options& opts, 
+                 const sugiyama_layout* layout = nullptr) 
+{
+    std::string tmp = file + ".tmp" + std::to_string(std::random_device{}());
+    {
+        std::ofstream out(tmp, std::ios::binary);
+        if (!out) {
+            throw std::invalid_argument("Failed to open '" + file + "'.");
+        }
+        detail::write_binary(out, g, attr, opts, layout);
+        out.close();
+        if (!out) {
+            std::filesystem::remove(tmp);
+            throw std::invalid_argument("Failed to write '" + file + "'.");
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmp, file, ec);
+    if (ec) {
+        std::filesystem::remove(tmp, ec);
+        throw std::invalid_argument("Failed to write '" + file + "'.");
+    }
+}
+
+
+/**
+ * Draws the layout saved in a binary cache, which has to contain one.
+ */
+void draw_to_svg(const std::string& file, const binary_graph& b, const drawing_options& opts) {
+    svg_img img(file, b.dimensions(), opts.margin, opts.compress);
+    const node* nodes = b.nodes_begin();
+    draw_elements(img, b.nodes_end() - nodes, opts.threads, [&] (svg_writer& out, std::size_t i) {
+        out.draw_circle(nodes[i].pos, nodes[i].size);
+        out.draw_text(nodes[i].pos, opts.use_labels ? opts.label(nodes[i].u) : std::to_string(nodes[i].u), opts.font_size );
+    });
+
+    const flat_path* paths = b.paths_begin();
+    draw_elements(img, b.paths_end() - paths, opts.threads, [&] (svg_writer& out, std::size_t i) {
+        float arrow_size = 0.4 * nodes[paths[i].from].size;
+        draw_path(out, b.points_of(paths[i]), paths[i].bidirectional, paths[i].spline, arrow_size);
+    });
+}
+
+
+/**
+ * Renders the layout saved in a binary cache, which has to contain one, into a raster image.
+ */
+raster_image rasterize(const binary_graph& b, const drawing_options& opts, float scale = 1, bool antialias = true) {
+    rasterizer img(b.dimensions(), opts.margin, scale, antialias);
+    const node* nodes = b.nodes_begin();
+    for (auto it = nodes; it != b.nodes_end(); ++it) {
+        img.draw_circle(it->pos, it->size);
+    }
+    for (auto it = b.paths_begin(); it != b.paths_end(); ++it) {
+        float arrow_size = 0.4 * nodes[it->from].size;
+        draw_path(img, b.points_of(*it), it->bidirectional, it->spline, arrow_size);
+    }
+    return img.render(opts.threads);
+}
@@ -1,29 +1,126 @@
-//#define REPORTING
-
 #include "helper.hpp"
 #include "interface.hpp"
 #include "svg.hpp"
 #include "parser.hpp"
-#include "report.hpp"
+#include "mapped_parser.hpp"
+#include "raster.hpp"
+#include "binary.hpp"
+#include "layout_cache.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
 #include <iostream>
+#include <mutex>
 #include <string>
+#include <thread>
+
+// layouts are memoised only if a cache directory is given
+std::unique_ptr<layout_cache> cache;
+
+// number of threads used for parsing and drawing a single graph
+unsigned file_threads = std::max(1u, std::thread::hardware_concurrency());
+
+void draw_layout(const graph& g, const attributes& attr, drawing_options& opts, const std::string& out) {
+	std::shared_ptr<const sugiyama_layout> l = cache ? cache->get(g, attr) 
+	                                                 : std::make_shared<sugiyama_layout>(g, attr);
+	if (ends_with(out, ".bin")) {
+		save_binary(out, g, attr, opts, l.get());
+	} else if (ends_with(out, ".png")) {
+		write_png(out, rasterize(*l, opts));
+	} else if (ends_with(out, ".ppm")) {
+		write_ppm(out, rasterize(*l, opts));
+	} else {
+		opts.compress = ends_with(out, ".svgz");
+		draw_to_svg(out, *l, opts);
+	}
+}
 
 void draw_graph(const std::string& in, const std::string& out) {
     attributes attr;
     drawing_options opts;
-	auto g = parse(in, attr, opts);
+    opts.threads = file_threads;
+
+	if (ends_with(in, ".bin")) {
+		binary_graph b(in);
+		b.get_labels(opts);
+		if (!b.has_layout() || ends_with(out, ".bin")) {
+			draw_layout(b.to_graph(), b.attribs(), opts, out);
+		} else if (ends_with(out, ".png")) {
+			write_png(out, rasterize(b, opts));
+		} else if (ends_with(out, ".ppm")) {
+			write_ppm(out, rasterize(b, opts));
+		} else {
+			opts.compress = ends_with(out, ".svgz");
+			draw_to_svg(out, b, opts);
+		}
+		return;
+	}
+
+	auto [ file, g ] = parse_mapped_parallel(in, attr, opts, file_threads);
+	draw_layout(g, attr, opts, out);
+}
+
+
+/**
+ * Draws all .gv files in the directory <path> into SVG images in <out> using <jobs> worker threads.
+ * The files are handed out from the largest one, so the long layouts do not end up at the tail.
+ * Returns false if any of the files failed.
+ */
+bool draw_dir(const std::string& path, const std::string& out, unsigned jobs) {
+    auto files = dir_contents(path, ".gv");
+    std::vector< std::pair<uintmax_t, std::string> > sized;
+    for (const auto& f : files) {
+        std::error_code ec;
+        auto size = std::filesystem::file_size(path + f, ec);
+        sized.emplace_back(ec ? 0 : size, f);
+    }
+    std::stable_sort(sized.begin(), sized.end(), [] (const auto& lhs, const auto& rhs) { 
+        return lhs.first > rhs.first; 
+    });
+
+    std::atomic<std::size_t> next = 0;
+    std::atomic<bool> ok = true;
+    std::mutex log;
+    auto worker = [&] {
+        for (std::size_t i = next++; i < sized.size(); i = next++) {
+            const auto& f = sized[i].second;
+            std::string out_file = out + "/" + f;
+            remove_suffix(out_file);
+            try {
+                draw_graph(path + f, out_file + ".svg");
+            } catch (const std::exception& e) {
+                std::lock_guard<std::mutex> lock(log);
+                std::cerr << path + f << ": " << e.what() << "\n";
+                ok = false;
+            }
+        }
+    };
 
-	sugiyama_layout l(g, attr);
-	draw_to_svg(out, l, opts);
+    std::vector<std::thread> workers;
+    for (unsigned j = 1; j < jobs; ++j) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (auto& w : workers) {
+        w.join();
+    }
+    return ok;
 }
 
 
 std::string usage_string =
-R"(usage: ./draw [-d] <source> <destination>
+R"(usage: ./draw [-d] [-j <jobs>] [-c <cache>] <source> <destination>
 
 Create an SVG image of a graph or a set of graphs.
     -d Draw all .gv files in the source directory to the destination directory.
+    -j Draw up to <jobs> files at once in the directory mode, starting with the largest ones.
+    -c Reuse the layouts saved in the <cache> directory and save the new ones there.
+
+If <destination> ends with .svgz, the image is compressed with gzip.
+If <destination> ends with .png or .ppm, a raster image without labels is rendered instead.
+If <destination> ends with .bin, the graph and its layout are saved in a binary cache instead.
+If <source> ends with .bin, the graph is read from a binary cache and its saved layout is drawn.
 )";
 
 void print_help() {
@@ -35,35 +132,38 @@ int main(int argc, char **argv) {
         print_help();
         return 0;
     }
-    if (argc < 3 || argc > 4) {
-        print_help();
-        return 1;
-    }
 
     bool print_dir = false;
+    unsigned jobs = 1;
     std::string path;
     std::string out;
 
     int i = 1;
-    if ( std::string{ argv[i] } == std::string{ "-d" } ) {
-        print_dir = true;
-        ++i;
-        if (argc != 4) {
+    for (; i < argc && argv[i][0] == '-'; ++i) {
+        std::string flag = argv[i];
+        if (flag == "-d") {
+            print_dir = true;
+        } else if (flag == "-j" && i + 1 < argc) {
+            jobs = std::max(1, std::atoi(argv[++i]));
+        } else if (flag == "-c" && i + 1 < argc) {
+            cache = std::make_unique<layout_cache>(64, argv[++i]);
+        } else {
             print_help();
             return 1;
         }
     }
+    if (argc - i != 2) {
+        print_help();
+        return 1;
+    }
 
     path = argv[i++];
     out = argv[i];
 
     if (print_dir) {
-        auto files = dir_contents(path, ".gv");
-		for (const auto& f : files) {
-            std::string out_file = out + "/" + f;
-            remove_suffix(out_file);
-			draw_graph(path + f, out_file + ".svg");
-		}
+        // the cores are split between the files drawn at once
+        file_threads = std::max(1u, file_threads/jobs);
+        return draw_dir(path, out, jobs) ? 0 : 1;
     } else {
 		draw_graph(path, out);
     }
@@ -0,0 +1,307 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+
+/**
+ * CRC-32 as used by gzip and png.
+ */
+inline uint32_t crc32_update(uint32_t crc, const unsigned char* data, std::size_t n) {
+    static const auto table = [] {
+        std::array<uint32_t, 256> t;
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            t[i] = c;
+        }
+        return t;
+    }();
+
+    crc = ~crc;
+    for (std::size_t i = 0; i < n; ++i) {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+
+namespace detail {
+
+/**
+ * Minimal deflate compressor used when zlib is not available.
+ *
+ * Finds matches with a hash chain over the last 32 KiB and encodes them with the fixed Huffman codes,
+ * so each call to compress() produces one self-contained block.
+ * The repetitive markup of SVG images compresses well even without dynamic codes.
+ */
+class fixed_deflate {
+public:
+    /**
+     * Compresses <n> bytes and appends the result to <out>.
+     * The last call has to have <last> set, possibly with no data.
+     */
+    void compress(const unsigned char* data, std::size_t n, bool last, std::vector<unsigned char>& out) {
+        window.insert(window.end(), data, data + n);
+        put_bits(last ? 1 : 0, 1);
+        put_bits(1, 2); // fixed Huffman codes
+
+        int64_t end = base + window.size();
+        int64_t i = end - n;
+        while (i < end) {
+            int64_t avail = end - i;
+            int len = 0, dist = 0;
+            if (avail >= min_match) {
+                find_match(i, avail, len, dist);
+            }
+
+            if (len >= min_match) {
+                put_length(len);
+                put_distance(dist);
+                for (int k = 0; k < len; ++k) {
+                    if (end - (i + k) >= min_match) insert(i + k);
+                }
+                i += len;
+            } else {
+                put_literal(at(i));
+                if (avail >= min_match) insert(i);
+                ++i;
+            }
+            flush_bits(out);
+        }
+        put_literal(256);
+
+        if (last) {
+            // pad the final byte
+            put_bits(0, (8 - bit_count % 8) % 8);
+        }
+        flush_bits(out);
+
+        if (window.size() > window_size) {
+            std::size_t drop = window.size() - window_size;
+            window.erase(window.begin(), window.begin() + drop);
+            base += drop;
+        }
+    }
+
+private:
+    static constexpr std::size_t window_size = 1 << 15;
+    static constexpr int min_match = 3;
+    static constexpr int max_match = 258;
+    static constexpr int max_chain = 32;
+    static constexpr int hash_bits = 15;
+
+    std::vector<unsigned char> window; // the history followed by the data being compressed
+    int64_t base = 0;                  // position of window[0] in the whole stream
+    std::vector<int64_t> head = std::vector<int64_t>(1 << hash_bits, -1);
+    std::vector<int64_t> prev = std::vector<int64_t>(window_size, -1);
+
+    uint64_t bits = 0;
+    int bit_count = 0;
+
+    unsigned char at(int64_t pos) const { return window[pos - base]; }
+
+    uint32_t hash(int64_t pos) const {
+        uint32_t x = at(pos) | (at(pos + 1) << 8) | (at(pos + 2) << 16);
+        return (x * 2654435761u) >> (32 - hash_bits);
+    }
+
+    void insert(int64_t pos) {
+        uint32_t h = hash(pos);
+        prev[pos & (window_size - 1)] = head[h];
+        head[h] = pos;
+    }
+
+    void find_match(int64_t pos, int64_t avail, int& best_len, int& best_dist) const {
+        int limit = static_cast<int>(std::min<int64_t>(avail, max_match));
+        int64_t cand = head[hash(pos)];
+        const unsigned char* cur = &window[pos - base];
+        for (int chain = 0; chain < max_chain && cand >= 0 && pos - cand <= static_cast<int64_t>(window_size); ++chain) {
+            const unsigned char* prv = &window[cand - base];
+            int len = 0;
+            while (len < limit && prv[len] == cur[len]) {
+                ++len;
+            }
+            if (len > best_len) {
+                best_len = len;
+                best_dist = pos - cand;
+                if (len == limit) {
+                    break;
+                }
+            }
+            int64_t next = prev[cand & (window_size - 1)];
+            if (next >= cand) {
+                break;
+            }
+            cand = next;
+        }
+    }
+
+    void put_bits(uint32_t value, int count) {
+        bits |= static_cast<uint64_t>(value) << bit_count;
+        bit_count += count;
+    }
+
+    // Huffman codes are stored starting with the most significant bit
+    void put_code(uint32_t code, int length) {
+        uint32_t reversed = 0;
+        for (int i = 0; i < length; ++i) {
+            reversed = (reversed << 1) | ((code >> i) & 1);
+        }
+        put_bits(reversed, length);
+    }
+
+    void put_literal(unsigned sym) {
+        if (sym < 144) {
+            put_code(0x30 + sym, 8);
+        } else if (sym < 256) {
+            put_code(0x190 + sym - 144, 9);
+        } else if (sym < 280) {
+            put_code(sym - 256, 7);
+        } else {
+            put_code(0xc0 + sym - 280, 8);
+        }
+    }
+
+    void put_length(int len) {
+        static const int base_len[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+        static const int extra[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                     3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+        int code = 28;
+        while (base_len[code] > len) {
+            --code;
+        }
+        put_literal(257 + code);
+        put_bits(len - base_len[code], extra[code]);
+    }
+
+    void put_distance(int dist) {
+        static const int base_dist[] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                         257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                                         8193, 12289, 16385, 24577 };
+        static const int extra[] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                     7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+        int code = 29;
+        while (base_dist[code] > dist) {
+            --code;
+        }
+        put_code(code, 5);
+        put_bits(dist - base_dist[code], extra[code]);
+    }
+
+    void flush_bits(std::vector<unsigned char>& out) {
+        while (bit_count >= 8) {
+            out.push_back(bits & 0xff);
+            bits >>= 8;
+            bit_count -= 8;
+        }
+    }
+};
+
+} // namespace detail
+
+
+/**
+ * Writes a gzip stream to a file, compressing the data as it arrives.
+ * Uses zlib if HAVE_ZLIB is defined and the bundled compressor otherwise.
+ */
+class gzip_writer {
+public:
+    explicit gzip_writer(std::ofstream& file) : file(file) {
+#ifdef HAVE_ZLIB
+        std::memset(&stream, 0, sizeof(stream));
+        // 16 added to the window bits selects the gzip wrapper
+        if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw std::runtime_error("Failed to initialize zlib.");
+        }
+#else
+        const unsigned char header[] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff };
+        file.write(reinterpret_cast<const char*>(header), sizeof(header));
+#endif
+    }
+
+    gzip_writer(const gzip_writer&) = delete;
+    gzip_writer& operator=(const gzip_writer&) = delete;
+
+    ~gzip_writer() {
+        finish();
+#ifdef HAVE_ZLIB
+        deflateEnd(&stream);
+#endif
+    }
+
+    void write(const char* data, std::size_t n) {
+        if (n == 0) {
+            return;
+        }
+        auto bytes = reinterpret_cast<const unsigned char*>(data);
+#ifdef HAVE_ZLIB
+        stream.next_in = const_cast<unsigned char*>(bytes);
+        stream.avail_in = n;
+        run(Z_NO_FLUSH);
+#else
+        crc = crc32_update(crc, bytes, n);
+        size += n;
+        compressor.compress(bytes, n, false, out);
+        write_out();
+#endif
+    }
+
+    /**
+     * Ends the stream. Called automatically by the destructor.
+     */
+    void finish() {
+        if (finished) {
+            return;
+        }
+        finished = true;
+#ifdef HAVE_ZLIB
+        stream.avail_in = 0;
+        run(Z_FINISH);
+#else
+        compressor.compress(nullptr, 0, true, out);
+        for (int i = 0; i < 4; ++i) out.push_back((crc >> (8*i)) & 0xff);
+        for (int i = 0; i < 4; ++i) out.push_back((size >> (8*i)) & 0xff);
+        write_out();
+#endif
+    }
+
+private:
+    std::ofstream& file;
+    bool finished = false;
+    std::vector<unsigned char> out;
+
+#ifdef HAVE_ZLIB
+    z_stream stream;
+
+    void run(int flush) {
+        out.resize(1 << 16);
+        do {
+            stream.next_out = out.data();
+            stream.avail_out = out.size();
+            deflate(&stream, flush);
+            file.write(reinterpret_cast<const char*>(out.data()), out.size() - stream.avail_out);
+        } while (stream.avail_out == 0);
+    }
+#else
+    detail::fixed_deflate compressor;
+    uint32_t crc = 0;
+    uint32_t size = 0;
+
+    void write_out() {
+        file.write(reinterpret_cast<const char*>(out.data()), out.size());
+        out.clear();
+    }
+#endif
+};
@@ -0,0 +1,763 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <charconv>
+#include <stdexcept>
+#include <cctype>
+#include <thread>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "graph.hpp"
+#include "types.hpp"
+#include "svg.hpp"
+#include "parser.hpp"
+#include "parallel.hpp"
+
+/**
+ * Read-only memory mapping of a whole file.
+ */
+class mapped_file {
+    const char* m_data = nullptr;
+    std::size_t m_size = 0;
+
+public:
+    mapped_file() = default;
+
+    explicit mapped_file(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::invalid_argument("Failed to open '" + path + "'.");
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw std::invalid_argument("Failed to open '" + path + "'.");
+        }
+
+        m_size = st.st_size;
+        if (m_size > 0) {
+            void* data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                ::close(fd);
+                throw std::invalid_argument("Failed to map '" + path + "'.");
+            }
+            ::madvise(data, m_size, MADV_SEQUENTIAL);
+            m_data = static_cast<const char*>(data);
+        }
+        ::close(fd);
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    mapped_file(mapped_file&& other) noexcept { swap(other); }
+    mapped_file& operator=(mapped_file&& other) noexcept {
+        swap(other);
+        return *this;
+    }
+
+    ~mapped_file() {
+        if (m_data) {
+            ::munmap(const_cast<char*>(m_data), m_size);
+        }
+    }
+
+    std::string_view contents() const { return { m_data, m_size }; }
+
+private:
+    void swap(mapped_file& other) {
+        std::swap(m_data, other.m_data);
+        std::swap(m_size, other.m_size);
+    }
+};
+
+
+/**
+ * Splits a DOT file into tokens. 
+ * Comments, preprocessor lines and whitespace are skipped.
+ */
+class dot_lexer {
+public:
+    enum class kind { id, lbrace, rbrace, lbracket, rbracket, equals, semicolon, comma, colon, edge_op, end };
+
+    struct token {
+        kind type;
+        std::string_view text; // the identifier without quotes, empty for other tokens
+        bool quoted = false;   // true for quoted and HTML identifiers, which are never keywords
+    };
+
+    dot_lexer(std::string_view text) : pos(text.data()), end(text.data() + text.size()) {
+        current = scan();
+    }
+
+    const token& peek() const { return current; }
+
+    // the position of the token returned by peek() in the text
+    const char* position() const { return token_start; }
+
+    token next() {
+        token t = current;
+        current = scan();
+        return t;
+    }
+
+    bool accept(kind type) {
+        if (current.type != type) {
+            return false;
+        }
+        next();
+        return true;
+    }
+
+    token expect(kind type, const char* what) {
+        if (current.type != type) {
+            throw std::invalid_argument(std::string("Expected ") + what + ".");
+        }
+        return next();
+    }
+
+private:
+    const char* pos;
+    const char* end;
+    token current;
+    const char* token_start;
+    bool line_start = true;
+
+    token scan() {
+        skip_ignored();
+        token_start = pos;
+        if (pos == end) {
+            return { kind::end, {} };
+        }
+
+        char c = *pos;
+        switch (c) {
+            case '{': ++pos; return { kind::lbrace, {} };
+            case '}': ++pos; return { kind::rbrace, {} };
+            case '[': ++pos; return { kind::lbracket, {} };
+            case ']': ++pos; return { kind::rbracket, {} };
+            case '=': ++pos; return { kind::equals, {} };
+            case ';': ++pos; return { kind::semicolon, {} };
+            case ',': ++pos; return { kind::comma, {} };
+            case ':': ++pos; return { kind::colon, {} };
+            case '"': return quoted();
+            case '<': return html();
+        }
+
+        if (c == '-' && pos + 1 != end && (pos[1] == '>' || pos[1] == '-')) {
+            pos += 2;
+            return { kind::edge_op, {} };
+        }
+
+        if (is_id_char(c) || c == '-' || c == '.') {
+            const char* start = pos++;
+            while (pos != end && (is_id_char(*pos) || *pos == '.')) {
+                ++pos;
+            }
+            return { kind::id, { start, static_cast<std::size_t>(pos - start) } };
+        }
+
+        throw std::invalid_argument(std::string("Unexpected character '") + c + "'.");
+    }
+
+    // a double quoted string, escaped quotes are kept in the text
+    token quoted() {
+        const char* start = ++pos;
+        while (pos != end && *pos != '"') {
+            if (*pos == '\\' && pos + 1 != end) {
+                ++pos;
+            }
+            ++pos;
+        }
+        if (pos == end) {
+            throw std::invalid_argument("Unterminated string.");
+        }
+        return { kind::id, { start, static_cast<std::size_t>(pos++ - start) }, true };
+    }
+
+    // an HTML string delimited by matching angle brackets
+    token html() {
+        const char* start = ++pos;
+        int depth = 1;
+        while (pos != end) {
+            if (*pos == '<') {
+                ++depth;
+            } else if (*pos == '>' && --depth == 0) {
+                break;
+            }
+            ++pos;
+        }
+        if (pos == end) {
+            throw std::invalid_argument("Unterminated HTML string.");
+        }
+        return { kind::id, { start, static_cast<std::size_t>(pos++ - start) }, true };
+    }
+
+    void skip_ignored() {
+        while (pos != end) {
+            char c = *pos;
+            if (c == '\n') {
+                line_start = true;
+                ++pos;
+            } else if (std::isspace(static_cast<unsigned char>(c))) {
+                ++pos;
+            } else if (c == '#' && line_start) {
+                skip_line();
+            } else if (c == '/' && pos + 1 != end && pos[1] == '/') {
+                skip_line();
+            } else if (c == '/' && pos + 1 != end && pos[1] == '*') {
+                pos += 2;
+                while (pos != end && !(*pos == '*' && pos + 1 != end && pos[1] == '/')) {
+                    ++pos;
+                }
+                pos = pos == end ? end : pos + 2;
+            } else {
+                line_start = false;
+                return;
+            }
+        }
+    }
+
+    void skip_line() {
+        while (pos != end && *pos != '\n') {
+            ++pos;
+        }
+    }
+
+public:
+    static bool is_id_char(char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || (c & 0x80);
+    }
+};
+
+
+/**
+ * Graph read from a memory mapped file.
+ * The labels saved in drawing_options::label_views point into the mapping,
+ * so they are only valid while this object exists.
+ */
+struct mapped_graph {
+    mapped_file file;
+    graph g;
+};
+
+
+/**
+ * Converts a value of a DOT attribute to a float.
+ */
+float dot_float(std::string_view value) {
+    float x;
+    auto [ ptr, err ] = std::from_chars(value.data(), value.data() + value.size(), x);
+    if (err != std::errc()) {
+        throw std::invalid_argument("Expected a float.");
+    }
+    return x;
+}
+
+/**
+ * Applies a graph attribute if it is one of the layout settings understood by the parsers.
+ */
+void apply_dot_setting(std::string_view key, std::string_view value, attributes& attr, drawing_options& opts) {
+    if (key == "ranksep") {
+        attr.layer_dist = to_pt(dot_float(value));
+    } else if (key == "nodesep") {
+        attr.node_dist = to_pt(dot_float(value));
+    } else if (key == "nodesize") {
+        attr.node_size = to_pt(dot_float(value));
+    } else if (key == "fontsize") {
+        opts.font_size = dot_float(value);
+    } else if (key == "loopangle") {
+        attr.loop_angle = dot_float(value);
+    } else if (key == "loopsize") {
+        attr.loop_size = to_pt(dot_float(value));
+    } else if (key == "splines") {
+        attr.routing = value == "spline" || value == "true" ? routing_method::spline
+                                                             : routing_method::polyline;
+    }
+}
+
+
+/**
+ * Single pass reader of the DOT language.
+ * 
+ * Supports quoted and HTML identifiers, edge chains (a -> b -> c), attribute lists,
+ * several statements on one line, subgraphs (also as endpoints of edges) and comments.
+ * From the attributes only the layout settings understood by parse() and the labels of nodes are used.
+ * Ports of nodes are ignored.
+ * 
+ * The result is passed to <Sink> which has to provide:
+ *     vertex_t add_node(std::string_view name)
+ *     void set_label(vertex_t u, std::string_view label)
+ *     void add_edge(vertex_t u, vertex_t v)
+ *     void setting(std::string_view key, std::string_view value)
+ */
+template<typename Sink>
+class dot_reader {
+    using kind = dot_lexer::kind;
+
+    dot_lexer lex;
+    Sink& out;
+    std::size_t text_size;
+
+    std::unordered_map<std::string_view, vertex_t> nodes;
+
+    // endpoint of an edge - a single node or all nodes of a subgraph
+    struct operand {
+        std::string_view name;
+        std::size_t begin, end; // range in 'members' for subgraphs
+        bool subgraph;
+    };
+    std::vector<operand> operands;
+
+    // nodes mentioned in the currently open subgraphs
+    std::vector<vertex_t> members;
+    int depth = 0;
+
+    // attributes of the current statement
+    std::vector< std::pair<std::string_view, std::string_view> > attrs;
+
+public:
+    dot_reader(std::string_view text, Sink& out) 
+        : lex(text), out(out), text_size(text.size()) {}
+
+    // reads a whole graph
+    void read() {
+        nodes.reserve(text_size / 32);
+        read_header();
+        read_statements();
+        lex.expect(kind::rbrace, "'}'");
+    }
+
+    /**
+     * Reads the text as a sequence of statements without the enclosing graph.
+     * Used for reading a part of the body of a graph.
+     */
+    void read_body() {
+        nodes.reserve(text_size / 32);
+        read_statements();
+        lex.expect(kind::end, "the end of the statement list");
+    }
+
+    /**
+     * Reads everything up to and including the opening brace of the graph.
+     * 
+     * @return the position just after the brace
+     */
+    const char* read_header() {
+        if (keyword(lex.peek(), "strict")) {
+            lex.next();
+        }
+        auto type = lex.expect(kind::id, "'graph' or 'digraph'");
+        if (!keyword(type, "graph") && !keyword(type, "digraph")) {
+            throw std::invalid_argument("Expected 'graph' or 'digraph'.");
+        }
+        lex.accept(kind::id);
+        lex.expect(kind::lbrace, "'{'");
+        return lex.position();
+    }
+
+private:
+    // keywords are case insensitive and never quoted, so "node" is an ordinary identifier
+    static bool keyword(const dot_lexer::token& t, std::string_view kw) {
+        return t.type == kind::id && !t.quoted && t.text.size() == kw.size() &&
+            std::equal(t.text.begin(), t.text.end(), kw.begin(), [] (char a, char b) {
+                return std::tolower(static_cast<unsigned char>(a)) == b;
+            });
+    }
+
+    vertex_t get_node(std::string_view name) {
+        auto [ it, inserted ] = nodes.try_emplace(name, 0);
+        if (inserted) {
+            it->second = out.add_node(name);
+        }
+        members.push_back(it->second);
+        return it->second;
+    }
+
+    void read_statements() {
+        while (lex.peek().type != kind::rbrace && lex.peek().type != kind::end) {
+            read_statement();
+            lex.accept(kind::semicolon);
+            if (depth == 0) {
+                members.clear();
+            }
+        }
+    }
+
+    void read_statement() {
+        const auto& t = lex.peek();
+        if (keyword(t, "graph") || keyword(t, "node") || keyword(t, "edge")) {
+            bool is_graph = keyword(lex.next(), "graph");
+            read_attr_lists();
+            if (is_graph) {
+                for (auto [ key, value ] : attrs) {
+                    out.setting(key, value);
+                }
+            }
+            return;
+        }
+
+        std::size_t first_operand = operands.size();
+        operands.push_back( read_operand() );
+
+        if (!operands.back().subgraph && lex.peek().type == kind::equals) {
+            lex.next();
+            out.setting(operands.back().name, lex.expect(kind::id, "a value").text);
+            operands.pop_back();
+            return;
+        }
+
+        while (lex.accept(kind::edge_op)) {
+            operands.push_back( read_operand() );
+        }
+        read_attr_lists();
+
+        if (operands.size() - first_operand == 1) {
+            if (!operands.back().subgraph) {
+                vertex_t u = get_node(operands.back().name);
+                for (auto [ key, value ] : attrs) {
+                    if (key == "label") {
+                        out.set_label(u, value);
+                    }
+                }
+            }
+        } else {
+            for (std::size_t i = first_operand + 1; i < operands.size(); ++i) {
+                add_edges(operands[i - 1], operands[i]);
+            }
+        }
+        operands.resize(first_operand);
+    }
+
+    operand read_operand() {
+        const auto& t = lex.peek();
+        if (t.type == kind::lbrace || keyword(t, "subgraph")) {
+            if (lex.next().type == kind::id) {
+                lex.accept(kind::id);
+                lex.expect(kind::lbrace, "'{'");
+            }
+            std::size_t begin = members.size();
+            ++depth;
+            read_statements();
+            --depth;
+            lex.expect(kind::rbrace, "'}'");
+
+            // the same node can be mentioned several times
+            std::sort(members.begin() + begin, members.end());
+            members.erase(std::unique(members.begin() + begin, members.end()), members.end());
+            return { {}, begin, members.size(), true };
+        }
+
+        auto name = lex.expect(kind::id, "a node identifier").text;
+        // skip the port
+        while (lex.accept(kind::colon)) {
+            lex.expect(kind::id, "a port");
+        }
+        return { name, 0, 0, false };
+    }
+
+    // the target is resolved first to keep the order of identifiers assigned by parse()
+    void add_edges(const operand& from, const operand& to) {
+        if (!to.subgraph && !from.subgraph) {
+            vertex_t v = get_node(to.name);
+            vertex_t u = get_node(from.name);
+            out.add_edge(u, v);
+            return;
+        }
+
+        std::size_t to_begin = to.begin, to_end = to.end;
+        if (!to.subgraph) {
+            to_begin = members.size();
+            get_node(to.name);
+            to_end = members.size();
+        }
+        std::size_t from_begin = from.begin, from_end = from.end;
+        if (!from.subgraph) {
+            from_begin = members.size();
+            get_node(from.name);
+            from_end = members.size();
+        }
+
+        for (auto i = from_begin; i < from_end; ++i) {
+            for (auto j = to_begin; j < to_end; ++j) {
+                out.add_edge(members[i], members[j]);
+            }
+        }
+    }
+
+    void read_attr_lists() {
+        attrs.clear();
+        while (lex.accept(kind::lbracket)) {
+            while (lex.peek().type == kind::id) {
+                auto key = lex.next().text;
+                std::string_view value = "true";
+                if (lex.accept(kind::equals)) {
+                    value = lex.expect(kind::id, "a value").text;
+                }
+                attrs.emplace_back(key, value);
+                if (!lex.accept(kind::comma)) {
+                    lex.accept(kind::semicolon);
+                }
+            }
+            lex.expect(kind::rbracket, "']'");
+        }
+    }
+};
+
+
+/**
+ * Saves the output of dot_reader directly into a graph.
+ */
+struct graph_sink {
+    graph& g;
+    attributes& attr;
+    drawing_options& opts;
+
+    vertex_t add_node(std::string_view name) {
+        opts.label_views.push_back(name);
+        return g.add_node();
+    }
+    void set_label(vertex_t u, std::string_view label) { opts.label_views[u] = label; }
+    void add_edge(vertex_t u, vertex_t v) { g.add_edge(u, v); }
+    void setting(std::string_view key, std::string_view value) { apply_dot_setting(key, value, attr, opts); }
+};
+
+
+/**
+ * Reads a graph in the DOT language from a memory mapped file (see dot_reader),
+ * without copying the file or the names of the vertices.
+ * The names are interned in a hash table of views into the mapped file.
+ */
+mapped_graph parse_mapped(mapped_file file, attributes& attr, drawing_options& opts) {
+    mapped_graph res{ std::move(file), graph() };
+    opts.label_views.clear();
+    graph_sink sink{ res.g, attr, opts };
+    dot_reader<graph_sink>(res.file.contents(), sink).read();
+    return res;
+}
+
+mapped_graph parse_mapped(const std::string& file, attributes& attr, drawing_options& opts) {
+    return parse_mapped(mapped_file(file), attr, opts);
+}
+
+
+/**
+ * Saves the output of dot_reader for one part of a file.
+ * The identifiers of vertices are local to the part.
+ */
+struct chunk_sink {
+    std::vector< std::string_view > names;
+    std::vector< std::pair<vertex_t, vertex_t> > edges;
+    std::vector< std::pair<vertex_t, std::string_view> > labels;
+    std::vector< std::pair<std::string_view, std::string_view> > settings;
+
+    vertex_t add_node(std::string_view name) {
+        names.push_back(name);
+        return names.size() - 1;
+    }
+    void set_label(vertex_t u, std::string_view label) { labels.emplace_back(u, label); }
+    void add_edge(vertex_t u, vertex_t v) { edges.emplace_back(u, v); }
+    void setting(std::string_view key, std::string_view value) { settings.emplace_back(key, value); }
+};
+
+
+/**
+ * Finds the first line break at or after <target> which ends a statement of the top level of <body>.
+ * The scan starts at <begin>, which has to be the start of a statement of the top level.
+ * 
+ * Strings, HTML strings and comments are skipped, and a line break is not used
+ * inside an attribute list or a subgraph, after a token which needs a continuation
+ * (an edge operator, '=', ':', ',' or 'subgraph') or before a line which does not start
+ * with an identifier.
+ * 
+ * @return the position just after the line break, or the size of the body if there is none
+ */
+std::size_t find_statement_break(std::string_view body, std::size_t begin, std::size_t target) {
+    auto starts_statement = [body] (std::size_t i) {
+        while (i < body.size() && (body[i] == ' ' || body[i] == '\t' || body[i] == '\r')) {
+            ++i;
+        }
+        return i < body.size() && (dot_lexer::is_id_char(body[i]) || body[i] == '"' || body[i] == '<');
+    };
+    auto skip_until = [body] (std::size_t i, std::string_view delim) {
+        i = body.find(delim, i);
+        return i == std::string_view::npos ? body.size() : i;
+    };
+
+    int depth = 0;       // open brackets and braces
+    bool open = true;    // the last token can not end a statement
+    bool line_start = true;
+    std::size_t i = begin;
+    while (i < body.size()) {
+        char c = body[i];
+        if (c == '\n') {
+            if (i >= target && depth == 0 && !open && starts_statement(i + 1)) {
+                return i + 1;
+            }
+            line_start = true;
+            ++i;
+            continue;
+        }
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            ++i;
+            continue;
+        }
+
+        bool first = line_start;
+        line_start = false;
+        char next = i + 1 < body.size() ? body[i + 1] : '\0';
+        if ((c == '#' && first) || (c == '/' && next == '/')) {
+            i = skip_until(i, "\n");
+        } else if (c == '/' && next == '*') {
+            i = std::min(skip_until(i + 2, "*/") + 2, body.size());
+        } else if (c == '"') {
+            for (++i; i < body.size() && body[i] != '"'; ++i) {
+                if (body[i] == '\\') {
+                    ++i;
+                }
+            }
+            i = std::min(i + 1, body.size());
+            open = false;
+        } else if (c == '<') {
+            int html = 0;
+            for (; i < body.size(); ++i) {
+                if (body[i] == '<') {
+                    ++html;
+                } else if (body[i] == '>' && --html == 0) {
+                    break;
+                }
+            }
+            i = std::min(i + 1, body.size());
+            open = false;
+        } else if (c == '-' && (next == '>' || next == '-')) {
+            i += 2;
+            open = true;
+        } else if (dot_lexer::is_id_char(c) || c == '-' || c == '.') {
+            std::size_t start = i++;
+            while (i < body.size() && (dot_lexer::is_id_char(body[i]) || body[i] == '.')) {
+                ++i;
+            }
+            auto word = body.substr(start, i - start);
+            open = word.size() == 8 && std::equal(word.begin(), word.end(), "subgraph", [] (char a, char b) {
+                return std::tolower(static_cast<unsigned char>(a)) == b;
+            });
+        } else {
+            if (c == '[' || c == '{') {
+                ++depth;
+            } else if ((c == ']' || c == '}') && depth > 0) {
+                --depth;
+            }
+            open = c == '=' || c == ':' || c == ',';
+            ++i;
+        }
+    }
+    return body.size();
+}
+
+
+/**
+ * Reads a graph like parse_mapped(), but splits the body of the graph into parts
+ * which are read on up to <threads> threads.
+ * 
+ * The parts are split only at line breaks which end a statement of the top level (see find_statement_break()),
+ * so statements spanning several lines are kept whole. If a part still can not be read on its own,
+ * the whole file is read again by parse_mapped(), which also reports errors of malformed files.
+ * The result, including the identifiers of vertices, is the same as the result of parse_mapped().
+ * Small files are read on a single thread.
+ * 
+ * @param parts_read if not null, set to the number of parts read separately, or to 0 if the whole file was read by parse_mapped()
+ */
+mapped_graph parse_mapped_parallel(const std::string& file, attributes& attr, drawing_options& opts, unsigned threads,
+                                   std::size_t* parts_read = nullptr) {
+    const std::size_t min_chunk = 1 << 20;
+    if (parts_read) {
+        *parts_read = 0;
+    }
+
+    mapped_file mapping(file);
+    std::string_view text = mapping.contents();
+    if (threads <= 1 || text.size() < 2*min_chunk) {
+        return parse_mapped(std::move(mapping), attr, opts);
+    }
+
+    // find the body of the graph
+    chunk_sink header;
+    const char* body_start = dot_reader<chunk_sink>(text, header).read_header();
+    auto body_end = text.rfind('}');
+    if (body_end == std::string_view::npos || text.data() + body_end < body_start) {
+        throw std::invalid_argument("Expected '}'.");
+    }
+    std::string_view body(body_start, text.data() + body_end - body_start);
+
+    // split it between statements
+    threads = std::min<std::size_t>(threads, body.size() / min_chunk + 1);
+    std::vector<std::string_view> chunks;
+    std::size_t begin = 0;
+    for (unsigned i = 1; i <= threads && begin < body.size(); ++i) {
+        std::size_t end = i == threads ? body.size()
+                                       : find_statement_break(body, begin, std::max(begin, (body.size() * i) / threads));
+        if (end > begin) {
+            chunks.push_back( body.substr(begin, end - begin) );
+        }
+        begin = end;
+    }
+
+    std::vector<chunk_sink> parts(chunks.size());
+    try {
+        detail::parallel_for(chunks.size(), threads, [&] (std::size_t i) {
+            dot_reader<chunk_sink>(chunks[i], parts[i]).read_body();
+        });
+    } catch (const std::invalid_argument&) {
+        return parse_mapped(std::move(mapping), attr, opts);
+    }
+
+    // map the local identifiers to global ones in the order of the parts
+    mapped_graph res{ std::move(mapping), graph() };
+    opts.label_views.clear();
+    std::unordered_map<std::string_view, vertex_t> nodes;
+    nodes.reserve(text.size() / 32);
+
+    std::vector< std::vector<vertex_t> > remap(parts.size());
+    std::vector< std::size_t > edge_offsets(parts.size() + 1, 0);
+    for (std::size_t i = 0; i < parts.size(); ++i) {
+        auto& part = parts[i];
+        remap[i].resize(part.names.size());
+        for (std::size_t u = 0; u < part.names.size(); ++u) {
+            auto [ it, inserted ] = nodes.try_emplace(part.names[u], opts.label_views.size());
+            if (inserted) {
+                opts.label_views.push_back(part.names[u]);
+            }
+            remap[i][u] = it->second;
+        }
+        for (auto [ u, label ] : part.labels) {
+            opts.label_views[ remap[i][u] ] = label;
+        }
+        for (auto [ key, value ] : part.settings) {
+            apply_dot_setting(key, value, attr, opts);
+        }
+        edge_offsets[i + 1] = edge_offsets[i] + part.edges.size();
+    }
+
+    std::vector< std::pair<vertex_t, vertex_t> > edges(edge_offsets.back());
+    detail::parallel_for(parts.size(), threads, [&] (std::size_t i) {
+        for (std::size_t j = 0; j < parts[i].edges.size(); ++j) {
+            auto [ u, v ] = parts[i].edges[j];
+            edges[ edge_offsets[i] + j ] = { remap[i][u], remap[i][v] };
+        }
+    });
+
+    res.g = graph(opts.label_views.size(), edges);
+    if (parts_read) {
+        *parts_read = parts.size();
+    }
+    return res;
+}
@@ -80,6 +80,10 @@ graph parse(const std::string& file, attributes& attr, drawing_options& opts) {
                 attr.loop_angle = read_float(line_stream);
             } else if (first == "loopsize") {
                 attr.loop_size = to_pt(read_float(line_stream));
+            } else if (first == "splines") {
+                std::string value = read_word(line_stream);
+                attr.routing = value == "spline" || value == "true" ? routing_method::spline 
+                                                                     : routing_method::polyline;
             }
         } else if (a == '-' && line_stream.get() == '>') {
             line_stream >> std::ws;
@@ -0,0 +1,462 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "vec2.hpp"
+#include "types.hpp"
+#include "layout.hpp"
+#include "parallel.hpp"
+#include "svg.hpp"
+#include "gzip.hpp"
+
+
+/**
+ * Image with 8 bit RGBA pixels stored row by row.
+ */
+struct raster_image {
+    unsigned width = 0;
+    unsigned height = 0;
+    std::vector<uint8_t> pixels;
+
+    raster_image() = default;
+    raster_image(unsigned width, unsigned height)
+        : width(width)
+        , height(height)
+        , pixels(4ull*width*height, 255) {}
+
+    uint8_t* row(unsigned y) { return pixels.data() + 4ull*width*y; }
+    const uint8_t* row(unsigned y) const { return pixels.data() + 4ull*width*y; }
+};
+
+
+/**
+ * Draws the same shapes as svg_img directly into a raster image.
+ * Labels are not drawn.
+ *
+ * The shapes are first collected and sorted into square tiles of the image.
+ * The tiles are then rendered independently, each drawing its shapes in the original order,
+ * so the result does not depend on the number of threads.
+ */
+class rasterizer {
+public:
+    /**
+     * @param dims      the dimensions of the layout
+     * @param margin    margin around the layout, in the units of the layout
+     * @param scale     number of pixels per unit of the layout
+     * @param antialias compute the partial coverage of the pixels on the edges of the shapes
+     */
+    rasterizer(vec2 dims, float margin, float scale = 1, bool antialias = true)
+        : margin(margin)
+        , scale(scale)
+        , antialias(antialias)
+        , half_width(std::max(0.5f, 0.5f*scale))
+    {
+        width = std::max(1u, static_cast<unsigned>( std::ceil((dims.x + 2*margin)*scale) ));
+        height = std::max(1u, static_cast<unsigned>( std::ceil((dims.y + 2*margin)*scale) ));
+    }
+
+    void draw_circle(vec2 center, float r) {
+        add({ shape_type::circle, to_pixels(center), {}, {}, r*scale });
+    }
+
+    void draw_line(vec2 from, vec2 to) {
+        add({ shape_type::line, to_pixels(from), to_pixels(to), {}, 0 });
+    }
+
+    void draw_triangle(vec2 a, vec2 b, vec2 c) {
+        add({ shape_type::triangle, to_pixels(a), to_pixels(b), to_pixels(c), 0 });
+    }
+
+    void draw_polyline(point_span points) {
+        for (std::size_t i = 1; i < points.size(); ++i) {
+            draw_line(points[i - 1], points[i]);
+        }
+    }
+
+    // draws a curve in the format produced by detail::spline_router, flattened into line segments
+    void draw_spline(point_span points) {
+        constexpr int segments = 16;
+        auto draw_cubic = [this] (vec2 p0, vec2 c0, vec2 c1, vec2 p1) {
+            vec2 prev = p0;
+            for (int i = 1; i <= segments; ++i) {
+                float t = static_cast<float>(i)/segments;
+                float s = 1 - t;
+                vec2 p = s*s*s*p0 + 3*s*s*t*c0 + 3*s*t*t*c1 + t*t*t*p1;
+                draw_line(prev, p);
+                prev = p;
+            }
+        };
+
+        draw_cubic(points[0], points[1], points[2], points[3]);
+        for (std::size_t i = 4; i + 1 < points.size(); i += 2) {
+            vec2 start = points[i - 1];
+            vec2 reflected = 2*start - points[i - 2];
+            draw_cubic(start, reflected, points[i], points[i + 1]);
+        }
+    }
+
+    /**
+     * Renders all the shapes drawn so far using at most <threads> threads.
+     */
+    raster_image render(unsigned threads = 1) const {
+        raster_image img(width, height);
+        detail::parallel_for(tiles.size(), threads, [&] (std::size_t t) {
+            render_tile(img, t);
+        });
+        return img;
+    }
+
+private:
+    enum class shape_type { circle, line, triangle };
+
+    struct shape {
+        shape_type type;
+        vec2 a, b, c; // the center of a circle, the endpoints of a line, or the vertices of a triangle
+        float r;
+    };
+
+    static constexpr unsigned tile_size = 64;
+
+    float margin;
+    float scale;
+    bool antialias;
+    float half_width; // half of the width of the strokes in pixels
+    unsigned width;
+    unsigned height;
+
+    std::vector<shape> shapes;
+    std::vector< std::vector<unsigned> > tiles; // indices of the shapes overlapping each tile, in order
+
+    unsigned tiles_x() const { return (width + tile_size - 1)/tile_size; }
+    unsigned tiles_y() const { return (height + tile_size - 1)/tile_size; }
+
+    vec2 to_pixels(vec2 p) const { return (p + vec2{ margin, margin })*scale; }
+
+    void add(const shape& s) {
+        if (tiles.empty()) {
+            tiles.resize(tiles_x()*tiles_y());
+        }
+
+        vec2 lo, hi;
+        bounding_box(s, lo, hi);
+        int x0 = std::max(0, static_cast<int>(lo.x) / static_cast<int>(tile_size));
+        int y0 = std::max(0, static_cast<int>(lo.y) / static_cast<int>(tile_size));
+        int x1 = std::min<int>(tiles_x() - 1, static_cast<int>(hi.x) / static_cast<int>(tile_size));
+        int y1 = std::min<int>(tiles_y() - 1, static_cast<int>(hi.y) / static_cast<int>(tile_size));
+        if (hi.x < 0 || hi.y < 0) {
+            return;
+        }
+
+        unsigned idx = shapes.size();
+        shapes.push_back(s);
+        for (int y = y0; y <= y1; ++y) {
+            for (int x = x0; x <= x1; ++x) {
+                tiles[y*tiles_x() + x].push_back(idx);
+            }
+        }
+    }
+
+    void bounding_box(const shape& s, vec2& lo, vec2& hi) const {
+        float pad = half_width + 1;
+        switch (s.type) {
+        case shape_type::circle:
+            lo = s.a - vec2{ s.r + pad, s.r + pad };
+            hi = s.a + vec2{ s.r + pad, s.r + pad };
+            break;
+        case shape_type::line:
+            lo = { std::min(s.a.x, s.b.x) - pad, std::min(s.a.y, s.b.y) - pad };
+            hi = { std::max(s.a.x, s.b.x) + pad, std::max(s.a.y, s.b.y) + pad };
+            break;
+        case shape_type::triangle:
+            lo = { std::min({ s.a.x, s.b.x, s.c.x }) - pad, std::min({ s.a.y, s.b.y, s.c.y }) - pad };
+            hi = { std::max({ s.a.x, s.b.x, s.c.x }) + pad, std::max({ s.a.y, s.b.y, s.c.y }) + pad };
+            break;
+        }
+    }
+
+    // the portion of a pixel covered by a shape whose border is <d> pixels away from the center of the pixel
+    // (positive inside of the shape)
+    float coverage(float d) const {
+        if (!antialias) {
+            return d >= 0 ? 1 : 0;
+        }
+        return std::clamp(d + 0.5f, 0.0f, 1.0f);
+    }
+
+    static void blend(uint8_t* px, uint8_t value, float alpha) {
+        if (alpha <= 0) {
+            return;
+        }
+        for (int i = 0; i < 3; ++i) {
+            px[i] = static_cast<uint8_t>( std::lround(px[i] + (value - px[i])*alpha) );
+        }
+        px[3] = 255;
+    }
+
+    // distance from the segment, the projection of <p> is clamped to the endpoints
+    static float segment_dist(vec2 a, vec2 b, vec2 p) {
+        vec2 v = b - a;
+        float len = dot(v, v);
+        if (len == 0) {
+            return distance(a, p);
+        }
+        float t = std::clamp(dot(p - a, v) / len, 0.0f, 1.0f);
+        return distance(p, a + t*v);
+    }
+
+    // signed distance from the border of the triangle, positive inside
+    static float triangle_dist(const shape& s, vec2 p) {
+        float d = std::min({ segment_dist(s.a, s.b, p), segment_dist(s.b, s.c, p), segment_dist(s.c, s.a, p) });
+        float c0 = cross(s.b - s.a, p - s.a);
+        float c1 = cross(s.c - s.b, p - s.b);
+        float c2 = cross(s.a - s.c, p - s.c);
+        bool inside = (c0 >= 0 && c1 >= 0 && c2 >= 0) || (c0 <= 0 && c1 <= 0 && c2 <= 0);
+        return inside ? d : -d;
+    }
+
+    void render_tile(raster_image& img, std::size_t t) const {
+        unsigned tx = t % tiles_x();
+        unsigned ty = t / tiles_x();
+        int tile_x0 = tx*tile_size;
+        int tile_y0 = ty*tile_size;
+        int tile_x1 = std::min(width, (tx + 1)*tile_size);
+        int tile_y1 = std::min(height, (ty + 1)*tile_size);
+
+        for (auto idx : tiles[t]) {
+            const shape& s = shapes[idx];
+            vec2 lo, hi;
+            bounding_box(s, lo, hi);
+            int x0 = std::max(tile_x0, static_cast<int>(std::floor(lo.x)));
+            int y0 = std::max(tile_y0, static_cast<int>(std::floor(lo.y)));
+            int x1 = std::min(tile_x1, static_cast<int>(std::ceil(hi.x)));
+            int y1 = std::min(tile_y1, static_cast<int>(std::ceil(hi.y)));
+
+            for (int y = y0; y < y1; ++y) {
+                uint8_t* row = img.row(y);
+                for (int x = x0; x < x1; ++x) {
+                    vec2 p{ x + 0.5f, y + 0.5f };
+                    uint8_t* px = row + 4*x;
+                    switch (s.type) {
+                    case shape_type::circle: {
+                        float d = distance(s.a, p);
+                        blend(px, 255, coverage(s.r - d));
+                        blend(px, 0, coverage(half_width - std::abs(d - s.r)));
+                        break;
+                    }
+                    case shape_type::line:
+                        blend(px, 0, coverage(half_width - segment_dist(s.a, s.b, p)));
+                        break;
+                    case shape_type::triangle:
+                        blend(px, 0, coverage(half_width + triangle_dist(s, p)));
+                        break;
+                    }
+                }
+            }
+        }
+    }
+};
+
+
+void draw_arrow(rasterizer& img, vec2 from, vec2 to, float size) {
+    vec2 dir = normalized(from - to);
+    img.draw_triangle(to, to + size * rotate(dir, 20), to + size * rotate(dir, -20));
+}
+
+void draw_path(rasterizer& img, point_span points, bool bidirectional, bool spline, float arrow_size) {
+    if (spline) {
+        img.draw_spline(points);
+    } else {
+        img.draw_polyline(points);
+    }
+    draw_arrow(img, points[points.size() - 2], points.back(), arrow_size);
+    if (bidirectional) {
+        draw_arrow(img, points[1], points.front(), arrow_size);
+    }
+}
+
+
+/**
+ * Renders the layout into a raster image with the margin and the number of threads given by <opts>.
+ */
+raster_image rasterize(const sugiyama_layout& l, const drawing_options& opts, float scale = 1, bool antialias = true) {
+    rasterizer img(l.dimensions(), opts.margin, scale, antialias);
+    for (const auto& node : l.vertices()) {
+        img.draw_circle(node.pos, l.attribs().node_size);
+    }
+
+    float arrow_size = 0.4 * l.attribs().node_size;
+    for (const auto& path : l.edges()) {
+        draw_path(img, path.points, path.bidirectional, path.spline, arrow_size);
+    }
+    for (const auto& path : l.flat_edges().paths) {
+        draw_path(img, l.flat_edges().points_of(path), path.bidirectional, path.spline, arrow_size);
+    }
+    return img.render(opts.threads);
+}
+
+
+/**
+ * Writes the image in the binary PPM format. The alpha channel is dropped.
+ */
+void write_ppm(const std::string& file, const raster_image& img) {
+    std::ofstream out(file, std::ios::binary);
+    out << "P6\n" << img.width << " " << img.height << "\n255\n";
+    std::vector<char> line(3ull*img.width);
+    for (unsigned y = 0; y < img.height; ++y) {
+        const uint8_t* row = img.row(y);
+        for (unsigned x = 0; x < img.width; ++x) {
+            line[3*x] = row[4*x];
+            line[3*x + 1] = row[4*x + 1];
+            line[3*x + 2] = row[4*x + 2];
+        }
+        out.write(line.data(), line.size());
+    }
+}
+
+
+namespace detail {
+
+inline void put_u32_be(std::vector<uint8_t>& out, uint32_t x) {
+    for (int i = 3; i >= 0; --i) {
+        out.push_back((x >> (8*i)) & 0xff);
+    }
+}
+
+inline void write_u32_be(std::ofstream& out, uint32_t x) {
+    const char bytes[] = { char(x >> 24), char(x >> 16), char(x >> 8), char(x) };
+    out.write(bytes, 4);
+}
+
+inline void write_png_chunk(std::ofstream& out, const char* type, const uint8_t* data, std::size_t n) {
+    write_u32_be(out, n);
+    out.write(type, 4);
+    out.write(reinterpret_cast<const char*>(data), n);
+    uint32_t crc = crc32_update(0, reinterpret_cast<const unsigned char*>(type), 4);
+    write_u32_be(out, crc32_update(crc, data, n));
+}
+
+inline void write_png_chunk(std::ofstream& out, const char* type, const std::vector<uint8_t>& data) {
+    write_png_chunk(out, type, data.data(), data.size());
+}
+
+/**
+ * Writes image data of a known size as a zlib stream of uncompressed deflate blocks,
+ * split into IDAT chunks of at most 64 KiB. Only the current chunk is kept in memory.
+ */
+class png_data_writer {
+    static constexpr std::size_t chunk_size = 1 << 16;
+
+    std::ofstream& out;
+    std::vector<uint8_t> chunk;
+    uint64_t remaining;         // bytes of data not yet covered by a block header
+    std::size_t block_left = 0; // bytes left in the current block
+    uint32_t a = 1, b = 0;      // adler-32 of the data
+
+public:
+    png_data_writer(std::ofstream& out, uint64_t size) : out(out), remaining(size) {
+        chunk.reserve(chunk_size);
+        const uint8_t zlib_header[] = { 0x78, 0x01 };
+        put(zlib_header, 2);
+        if (size == 0) {
+            start_block();
+        }
+    }
+
+    void write(const uint8_t* data, std::size_t n) {
+        // the sums cannot overflow within 5552 bytes
+        for (std::size_t start = 0; start < n; start += 5552) {
+            std::size_t stop = std::min(n, start + 5552);
+            for (std::size_t k = start; k < stop; ++k) {
+                a += data[k];
+                b += a;
+            }
+            a %= 65521;
+            b %= 65521;
+        }
+
+        while (n > 0) {
+            if (block_left == 0) {
+                start_block();
+            }
+            std::size_t len = std::min(n, block_left);
+            put(data, len);
+            data += len;
+            n -= len;
+            block_left -= len;
+        }
+    }
+
+    // writes the checksum and the last chunk
+    void finish() {
+        uint32_t adler = (b << 16) | a;
+        const uint8_t bytes[] = { uint8_t(adler >> 24), uint8_t(adler >> 16), uint8_t(adler >> 8), uint8_t(adler) };
+        put(bytes, 4);
+        flush();
+    }
+
+private:
+    void start_block() {
+        std::size_t len = std::min<uint64_t>(65535, remaining);
+        remaining -= len;
+        block_left = len;
+        const uint8_t header[] = { uint8_t(remaining == 0 ? 1 : 0),
+                                   uint8_t(len & 0xff), uint8_t(len >> 8),
+                                   uint8_t(~len & 0xff), uint8_t((~len >> 8) & 0xff) };
+        put(header, 5);
+    }
+
+    void put(const uint8_t* data, std::size_t n) {
+        while (n > 0) {
+            std::size_t len = std::min(n, chunk_size - chunk.size());
+            chunk.insert(chunk.end(), data, data + len);
+            data += len;
+            n -= len;
+            if (chunk.size() == chunk_size) {
+                flush();
+            }
+        }
+    }
+
+    void flush() {
+        if (!chunk.empty()) {
+            write_png_chunk(out, "IDAT", chunk);
+            chunk.clear();
+        }
+    }
+};
+
+} // namespace detail
+
+
+/**
+ * Writes the image as an RGBA PNG.
+ * The pixel data is stored in uncompressed deflate blocks, which is fast to write but makes large files.
+ * The rows are streamed into the file, so no copy of the whole image is made.
+ */
+void write_png(const std::string& file, const raster_image& img) {
+    std::ofstream out(file, std::ios::binary);
+    const unsigned char signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    out.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+    std::vector<uint8_t> header;
+    detail::put_u32_be(header, img.width);
+    detail::put_u32_be(header, img.height);
+    header.insert(header.end(), { 8, 6, 0, 0, 0 }); // 8 bits per channel, RGBA, no interlacing
+    detail::write_png_chunk(out, "IHDR", header);
+
+    // each row is preceded by the filter type 0 (none)
+    std::size_t row_size = 4ull*img.width;
+    detail::png_data_writer data(out, (row_size + 1)*img.height);
+    const uint8_t filter = 0;
+    for (unsigned y = 0; y < img.height; ++y) {
+        data.write(&filter, 1);
+        data.write(img.row(y), row_size);
+    }
+    data.finish();
+    detail::write_png_chunk(out, "IEND", {});
+}
@@ -1,132 +1,292 @@
 #pragma once
 
+#include <algorithm>
+#include <charconv>
+#include <cstring>
 #include <fstream>
 #include <map>
+#include <string_view>
+#include <vector>
 
 #include "vec2.hpp"
 #include "layout.hpp"
+#include "parallel.hpp"
+#include "gzip.hpp"
 
 struct drawing_options {
     std::map<vertex_t, std::string> labels;
+    std::vector<std::string_view> label_views; // labels indexed by vertex, used instead of 'labels' if not empty
     float font_size = 12;
     bool use_labels = true;
     float margin = 15;
+    unsigned threads = 1; // number of threads formatting the elements of the image
+    bool compress = false; // write the image as gzip compressed SVGZ
+
+    std::string_view label(vertex_t u) const {
+        if (u < label_views.size()) {
+            return label_views[u];
+        }
+        return labels.at(u);
+    }
 };
 
 
-class svg_img {
+/**
+ * Formats the elements of an SVG image into a reusable character buffer.
+ *
+ * Numbers are formatted by std::to_chars with the same result as std::ostream with its default precision,
+ * so the images are identical to those written through iostreams.
+ */
+class svg_writer {
+public:
+    virtual ~svg_writer() = default;
+
+    void draw_polyline(point_span points, std::string_view color="black") {
+        append("<polyline points=\"");
+        const char* sep = "";
+        for (auto [ x, y ] : points) {
+            append(sep); append(x); append(' '); append(y);
+            sep = " ";
+        }
+        append("\" stroke=\""); append(color); append("\" fill=\"none\" />\n");
+        element_done();
+    }
+
+    // draws a curve in the format produced by detail::spline_router
+    void draw_spline(point_span points, std::string_view color="black") {
+        append("<path d=\"M"); append(points[0]);
+        append(" C"); append(points[1]); append(' '); append(points[2]); append(' '); append(points[3]);
+        for (std::size_t i = 4; i + 1 < points.size(); i += 2) {
+            append(" S"); append(points[i]); append(' '); append(points[i + 1]);
+        }
+        append("\" stroke=\""); append(color); append("\" fill=\"none\" />\n");
+        element_done();
+    }
+
+    void draw_circle(vec2 center, float r, std::string_view color="black") {
+        append("<circle cx=\""); append(center.x);
+        append("\" cy=\""); append(center.y);
+        append("\" r=\""); append(r);
+        append("\" stroke=\""); append(color);
+        append("\" stroke-width=\"1\" fill=\"white\" />\n");
+        element_done();
+    }
+
+    void draw_text(vec2 pos, std::string_view text, float size, std::string_view color="black") {
+        append("<text x=\""); append(pos.x);
+        append("\" y=\""); append(pos.y);
+        append("\" fill=\""); append(color);
+        append("\" dominant-baseline=\"middle\" text-anchor=\"middle\" font-size=\""); append(size);
+        append("\" font-family=\"Times,serif\" >"); append(text); append("</text>\n");
+        element_done();
+    }
+
+    void draw_polygon(point_span points, std::string_view color = "black") {
+        append("<polygon points=\"");
+        for (auto p : points) {
+            append(p.x); append(','); append(p.y); append(' ');
+        }
+        append("\" stroke=\""); append(color); append("\" />\n");
+        element_done();
+    }
+
+    /**
+     * Returns the formatted text which has not been written out yet.
+     */
+    std::string_view contents() const { return { buffer.data(), used }; }
+
+    void clear() { used = 0; }
+
+protected:
+    std::vector<char> buffer;
+    std::size_t used = 0;
+
+    // called after each element, allows writing out the buffer once it is large enough
+    virtual void element_done() {}
+
+    char* reserve(std::size_t n) {
+        if (used + n > buffer.size()) {
+            buffer.resize(std::max(2*buffer.size(), used + n));
+        }
+        return buffer.data() + used;
+    }
+
+    void append(std::string_view s) {
+        std::memcpy(reserve(s.size()), s.data(), s.size());
+        used += s.size();
+    }
+
+    void append(char c) {
+        *reserve(1) = c;
+        ++used;
+    }
+
+    void append(float x) {
+        constexpr std::size_t max_len = 32;
+        char* first = reserve(max_len);
+        used = std::to_chars(first, first + max_len, x, std::chars_format::general, 6).ptr - buffer.data();
+    }
+
+    void append(vec2 p) {
+        append(p.x); append(' '); append(p.y);
+    }
+};
+
+
+/**
+ * SVG image written to a file in large blocks.
+ * If compressed, the blocks are compressed as they are written, so the whole image is never kept in memory.
+ */
+class svg_img : public svg_writer {
     std::ofstream file;
+    std::unique_ptr<gzip_writer> gz;
+    static constexpr std::size_t block_size = 1 << 16;
 
 public:
 
-    svg_img(const std::string& filename, vec2 dims, float margin) : file(filename) {
+    svg_img(const std::string& filename, vec2 dims, float margin, bool compress = false) 
+        : file(filename, std::ios::binary) 
+    {
+        if (compress) {
+            gz = std::make_unique<gzip_writer>(file);
+        }
+        buffer.resize(2*block_size);
         float w = dims.x + 2*margin;
         float h = dims.y + 2*margin;
-        file << "<svg xmlns=\"http://www.w3.org/2000/svg\"\n";
-        file << "\txmlns:xlink=\"http://www.w3.org/1999/xlink\"\n";
-        file << "\txmlns:ev=\"http://www.w3.org/2001/xml-events\"\n";
-        file << "\twidth=\"" << w << "pt\" height=\"" << h << "pt\"\n";
-        file << "\tviewBox=\"0.00 0.00 " << w << " " << h << "\">\n";
-        file << "<rect width=\"" << w << "\" height=\"" << h << "\" fill=\"white\" stroke=\"transparent\" />";
-        file << "<g transform=\"scale(1 1) rotate(0) translate(" << margin << " " << margin << ")\">";
+        append("<svg xmlns=\"http://www.w3.org/2000/svg\"\n");
+        append("\txmlns:xlink=\"http://www.w3.org/1999/xlink\"\n");
+        append("\txmlns:ev=\"http://www.w3.org/2001/xml-events\"\n");
+        append("\twidth=\""); append(w); append("pt\" height=\""); append(h); append("pt\"\n");
+        append("\tviewBox=\"0.00 0.00 "); append(w); append(' '); append(h); append("\">\n");
+        append("<rect width=\""); append(w); append("\" height=\""); append(h); 
+        append("\" fill=\"white\" stroke=\"transparent\" />");
+        append("<g transform=\"scale(1 1) rotate(0) translate("); append(margin); append(' '); append(margin); append(")\">");
     }
 
     ~svg_img() { 
-        file << "</g>\n";
-        file << "</svg>\n";
+        append("</g>\n");
+        append("</svg>\n");
+        flush();
     }
 
-    void draw_polyline(std::vector<vec2> points, const std::string& color="black") {
-        file << "<polyline ";
-        file << "points=\"";
-        const char* sep = "";
-        for (auto [ x, y ] : points) {
-            file << sep << x << " " << y;
-            sep = " ";
+    void flush() {
+        write_out(buffer.data(), used);
+        used = 0;
+    }
+
+    /**
+     * Writes text formatted by another writer directly to the file.
+     */
+    void write(std::string_view text) {
+        flush();
+        write_out(text.data(), text.size());
+    }
+
+protected:
+    void element_done() override {
+        if (used >= block_size) {
+            flush();
         }
-        file << "\" stroke=\"" << color << "\" ";
-        file << "fill=\"none\" ";
-        file << "/>\n";
-    }
-
-    void draw_circle(vec2 center, float r, const std::string& color="black") {
-        file << "<circle ";
-        file << "cx=\"" << center.x << "\" ";
-        file << "cy=\"" << center.y << "\" ";
-        file << "r=\"" << r << "\" ";
-        file << "stroke=\"" << color << "\" ";
-        file << "stroke-width=\"1\" ";
-        file << "fill=\"white\" ";
-        file << "/>\n";
-    }
-
-    void draw_text(vec2 pos, const std::string& text, float size, const std::string& color="black") {
-        file << "<text ";
-        file << "x=\"" << pos.x << "\" ";
-        file << "y=\"" << pos.y << "\" ";
-        file << "fill=\"" << color << "\" ";
-        file << "dominant-baseline=\"middle\" ";
-        file << "text-anchor=\"middle\" ";
-        file << "font-size=\"" << size << "\" font-family=\"Times,serif\" ";
-        file << ">";
-        file << text;
-        file << "</text>\n";
-    }
-
-    void draw_polygon(const std::vector<vec2>& points, const std::string& color = "black") {
-        file << "<polygon ";
-        file << "points=\"";
-        for (auto p : points) {
-            file << p.x << "," << p.y << " ";
+    }
+
+private:
+    void write_out(const char* data, std::size_t n) {
+        if (gz) {
+            gz->write(data, n);
+        } else {
+            file.write(data, n);
         }
-        file << "\" ";
-        file << "stroke=\"" << color << "\" ";
-        file << "/>\n";
     }
 };
 
 
-void draw_arrow(svg_img& img, vec2 from, vec2 to, float size) {
+void draw_arrow(svg_writer& img, vec2 from, vec2 to, float size) {
     vec2 dir = from - to;
     dir = normalized(dir);
-    img.draw_polygon( { to, to + size * rotate(dir, 20), to + size * rotate(dir, -20) } );
+    vec2 points[3] = { to, to + size * rotate(dir, 20), to + size * rotate(dir, -20) };
+    img.draw_polygon( { points, 3 } );
+}
+
+
+void draw_path(svg_writer& img, point_span points, bool bidirectional, bool spline, float arrow_size) {
+    if (spline) {
+        img.draw_spline(points);
+    } else {
+        img.draw_polyline(points);
+    }
+    draw_arrow(img, points[points.size() - 2], points.back(), arrow_size);
+    if (bidirectional) {
+        draw_arrow(img, points[1], points.front(), arrow_size);
+    }
 }
 
 
-void draw_to_svg(svg_img& img,
+void draw_to_svg(svg_writer& img,
                  const std::vector<node>& nodes,
                  const std::vector<path>& paths,
                  const drawing_options& opts)
 {
     for (const auto& node : nodes) {
         img.draw_circle(node.pos, node.size);
-        img.draw_text(node.pos, opts.use_labels ? opts.labels.at(node.u) : std::to_string(node.u), opts.font_size  );
+        img.draw_text(node.pos, opts.use_labels ? opts.label(node.u) : std::to_string(node.u), opts.font_size  );
     }
 
     
     for (const auto& path : paths) {
         float arrow_size = nodes[path.from].size * 0.4;
-        img.draw_polyline(path.points);
-        draw_arrow(img, path.points[path.points.size() - 2], path.points.back(), arrow_size);
-        if (path.bidirectional) {
-            draw_arrow(img, path.points[1], path.points.front(), arrow_size);
-        }
+        draw_path(img, path.points, path.bidirectional, path.spline, arrow_size);
     }
 }
 
-void draw_to_svg(const std::string& file, const sugiyama_layout& l, const drawing_options& opts) {
-    svg_img img(file, l.dimensions(), opts.margin);
-    for (const auto& node : l.vertices()) {
-        img.draw_circle(node.pos, l.attribs().node_size);
-        img.draw_text(node.pos, opts.use_labels ? opts.labels.at(node.u) : std::to_string(node.u), opts.font_size );
+/**
+ * Calls draw(writer, i) for all i in [0, n) so that the elements appear in the image in the order of i.
+ *
+ * With more than one thread, consecutive ranges of elements are formatted into separate buffers in parallel,
+ * which are then written one after another, so the result is identical to drawing them sequentially.
+ * The elements are processed in rounds to bound the size of the buffers.
+ */
+template<typename F>
+void draw_elements(svg_img& img, std::size_t n, unsigned threads, F draw) {
+    if (threads <= 1) {
+        for (std::size_t i = 0; i < n; ++i) {
+            draw(img, i);
+        }
+        return;
     }
 
-    float arrow_size = 0.4 * l.attribs().node_size;
-    for (const auto& path : l.edges()) {
-        img.draw_polyline(path.points);
-        draw_arrow(img, path.points[path.points.size() - 2], path.points.back(), arrow_size);
-        if (path.bidirectional) {
-            draw_arrow(img, path.points[1], path.points.front(), arrow_size);
+    constexpr std::size_t round_size = 1 << 14; // elements per thread in one round
+    std::vector<svg_writer> shards(threads);
+    for (std::size_t start = 0; start < n; start += round_size*threads) {
+        std::size_t count = std::min(n - start, round_size*threads);
+        for (auto& shard : shards) {
+            shard.clear();
+        }
+        detail::parallel_chunks(count, threads, [&] (unsigned shard, std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; ++i) {
+                draw(shards[shard], start + i);
+            }
+        });
+        for (const auto& shard : shards) {
+            img.write(shard.contents());
         }
     }
 }
+
+void draw_to_svg(const std::string& file, const sugiyama_layout& l, const drawing_options& opts) {
+    svg_img img(file, l.dimensions(), opts.margin, opts.compress);
+    const auto& nodes = l.vertices();
+    draw_elements(img, nodes.size(), opts.threads, [&] (svg_writer& out, std::size_t i) {
+        out.draw_circle(nodes[i].pos, l.attribs().node_size);
+        out.draw_text(nodes[i].pos, opts.use_labels ? opts.label(nodes[i].u) : std::to_string(nodes[i].u), opts.font_size );
+    });
+
+    float arrow_size = 0.4 * l.attribs().node_size;
+    const auto& paths = l.edges();
+    draw_elements(img, paths.size(), opts.threads, [&] (svg_writer& out, std::size_t i) {
+        draw_path(out, paths[i].points, paths[i].bidirectional, paths[i].spline, arrow_size);
+    });
+    const auto& flat = l.flat_edges();
+    draw_elements(img, flat.size(), opts.threads, [&] (svg_writer& out, std::size_t i) {
+        draw_path(out, flat.points_of(i), flat.paths[i].bidirectional, flat.paths[i].spline, arrow_size);
+    });
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+
+/**
+ * Thrown by a layout which was stopped through its cancellation_token.
+ */
+struct layout_cancelled : std::runtime_error {
+    layout_cancelled() : std::runtime_error("The layout was cancelled.") {}
+};
+
+/**
+ * Allows stopping a layout running in another thread.
+ * Copies of a token share the same state, so one copy can be given to the layout and another one kept for cancelling it.
+ */
+class cancellation_token {
+public:
+    cancellation_token() : flag(std::make_shared< std::atomic<bool> >(false)) {}
+
+    void cancel() { flag->store(true, std::memory_order_relaxed); }
+    bool cancelled() const { return flag->load(std::memory_order_relaxed); }
+
+    /**
+     * Throws layout_cancelled if the token was cancelled.
+     */
+    void check() const {
+        if (cancelled()) {
+            throw layout_cancelled();
+        }
+    }
+
+private:
+    std::shared_ptr< std::atomic<bool> > flag;
+};
+
+
+namespace detail {
+
+// the modules get no token when the layout cannot be cancelled
+inline void check_cancelled(const cancellation_token* token) {
+    if (token) {
+        token->check();
+    }
+}
+
+} // namespace detail
@@ -4,10 +4,13 @@
 #include <iostream>
 #include <random>
 #include <cassert>
+#include <cmath>
+#include <limits>
 
 #include "layering.hpp"
 #include "utils.hpp"
 #include "report.hpp"
+#include "cancellation.hpp"
 
 namespace detail {
 
@@ -43,13 +46,13 @@ int crossing_number(const hierarchy& h, vertex_t u, vertex_t v) {
 
 // counts the number of crossings between layers with index 'layer' and 'layer - 1'
 int count_layer_crossings(const hierarchy& h, int layer) {
-    const std::vector<vertex_t>& upper = h.layers[layer - 1];
+    const std::pmr::vector<vertex_t>& upper = h.layers[layer - 1];
     int count = 0;
 
-    for (int i = 0; i < upper.size() - 1; ++i) {
+    for (int i = 0; i < static_cast<int>(upper.size()) - 1; ++i) {
         for ( auto u : h.g.out_neighbours(upper[i]) ) {
             int j = h.pos[u];
-            for (int s = i + 1; s < upper.size(); ++s) {
+            for (int s = i + 1; s < static_cast<int>(upper.size()); ++s) {
                 for ( auto v : h.g.out_neighbours(upper[s]) ) {
                     int t = h.pos[v];
                     if ( (s > i && t < j) || (s < i && t > j) ) {
@@ -74,6 +77,66 @@ int count_crossings(const hierarchy& h) {
 }
 
 
+// ----------------------------------------------------------------------------------------------
+// -------------------------------  ORDER FROM HINTS  -------------------------------------------
+// ----------------------------------------------------------------------------------------------
+
+/**
+ * Extends the hints of the original vertices to all the vertices of the hierarchy.
+ * Vertices without a hint (NaN) take the average hint of their neighbours, or go last if none of them has one.
+ * Dummy vertices are spread evenly between the ends of their edge.
+ */
+vertex_map<float> spread_hints(const hierarchy& h, const std::pmr::vector<long_edge>& long_edges, const std::vector<float>& hints) {
+    constexpr float last = std::numeric_limits<float>::max();
+    vertex_map<float> res(h.g, last);
+    auto known = [&] (vertex_t u) { return !h.g.is_dummy(u) && u < hints.size() && !std::isnan(hints[u]); };
+
+    for (auto u : h.g.vertices()) {
+        if (known(u)) {
+            res[u] = hints[u];
+        }
+    }
+    for (auto u : h.g.vertices()) {
+        if (h.g.is_dummy(u) || known(u)) {
+            continue;
+        }
+        float sum = 0;
+        int count = 0;
+        for (auto v : h.g.neighbours(u)) {
+            if (known(v)) {
+                sum += hints[v];
+                ++count;
+            }
+        }
+        if (count > 0) {
+            res[u] = sum/count;
+        }
+    }
+
+    for (const auto& e : long_edges) {
+        float from = res[e.path.front()];
+        float to = res[e.path.back()];
+        if (from == last) from = to;
+        if (to == last) to = from;
+        for (std::size_t i = 1; i + 1 < e.path.size(); ++i) {
+            float t = static_cast<float>(i)/(e.path.size() - 1);
+            res[e.path[i]] = from == last ? last : from + (to - from)*t;
+        }
+    }
+    return res;
+}
+
+/**
+ * Orders the vertices on each layer by their hints, keeping the current order of the vertices with equal hints.
+ */
+void order_by_hints(hierarchy& h, const vertex_map<float>& hints) {
+    for (auto& layer : h.layers) {
+        std::stable_sort(layer.begin(), layer.end(), [&hints] (vertex_t u, vertex_t v) { return hints[u] < hints[v]; });
+    }
+    h.update_pos();
+}
+
+
 // ----------------------------------------------------------------------------------------------
 // -------------------------------  CROSSING REDUCTION  -----------------------------------------
 // ----------------------------------------------------------------------------------------------
@@ -89,7 +152,18 @@ struct crossing_reduction {
      * It should leave h in a consistent state - ranking, layers and pos all agree with each other.
      */
     virtual void run(hierarchy& h) = 0;
+
+    /**
+     * Improves the current order of the layers instead of computing a new one,
+     * so a good initial order, for example one taken from a previous layout, stays mostly intact.
+     * By default the current order is discarded and run() is used.
+     */
+    virtual void refine(hierarchy& h) { run(h); }
+
     virtual ~crossing_reduction() = default;
+
+    component_stats* stats = nullptr; /**< statistics of the component being processed, if collected */
+    const cancellation_token* cancel = nullptr; /**< checked regularly if set */
 };
 
 
@@ -100,6 +174,7 @@ struct crossing_reduction {
 class barycentric_heuristic : public crossing_reduction {
     unsigned random_iters = 1;
     unsigned forgiveness = 7;
+    unsigned refine_forgiveness = 2;
     bool trans = true;
 
     std::mt19937 mt;
@@ -113,20 +188,14 @@ public:
         : random_iters(rnd_iters), forgiveness(max_fails), trans(do_transpose) {}
 
     void run(hierarchy& h) override {
-#ifdef REPORTING
-        report::base = min_cross;
-        report::random_runs = max_iters;
-        report::forgivness = forgiveness;
-        report::transpose = trans;
-        report::random_final.clear();
-        report::iters = 0;
-#endif
-
         min_cross = init_order(h);
         best_order = h.pos;
+        if (stats) {
+            stats->initial_crossings = min_cross;
+        }
         int base = min_cross;
-        for (int i = 0; i < random_iters; ++i) {
-            reduce(h, base);
+        for (unsigned i = 0; i < random_iters; ++i) {
+            reduce(h, base, forgiveness);
             
             if (i != random_iters - 1) {
                 for (auto& l : h.layers) {
@@ -137,14 +206,36 @@ public:
             }
         }
 
-        for (auto u : h.g.vertices()) {
-            h.layer(u)[ best_order[u] ] = u;
-        }
+        apply_best_order(h);
+    }
+
+    /**
+     * Starts with the current order and uses only the transpose heuristic and a few barycenter sweeps.
+     * A pass which does not reduce the number of crossings is undone before the next one.
+     */
+    void refine(hierarchy& h) override {
         h.update_pos();
+        min_cross = count_crossings(h);
+        best_order = h.pos;
+        if (stats) {
+            stats->initial_crossings = min_cross;
+        }
 
-#ifdef REPORTING
-        report::final = min_cross;
-#endif
+        if (trans && min_cross > 0) {
+            transpose(h);
+            int cross = count_crossings(h);
+            if (cross < min_cross) {
+                min_cross = cross;
+                best_order = h.pos;
+            } else {
+                set_order(h, best_order);
+            }
+        }
+        if (min_cross > 0) {
+            reduce(h, min_cross, refine_forgiveness, true);
+        }
+
+        apply_best_order(h);
     }
 
     int init_order(hierarchy& h) {
@@ -153,12 +244,31 @@ public:
     }
 
 private:
-    // attempts to reduce the number of crossings
-    void reduce(hierarchy& h, int local_min) {
+    // rearranges the layers so that the positions of vertices are <order>
+    void set_order(hierarchy& h, const vertex_map<int>& order) {
+        for (auto u : h.g.vertices()) {
+            h.layer(u)[ order[u] ] = u;
+        }
+        h.update_pos();
+    }
+
+    void apply_best_order(hierarchy& h) {
+        set_order(h, best_order);
+
+        if (stats) {
+            stats->final_crossings = min_cross;
+        }
+    }
+
+    // attempts to reduce the number of crossings, gives up after <max_fails> sweeps without improvement;
+    // if <restore> is set, each sweep without improvement is undone before the next one
+    void reduce(hierarchy& h, int local_min, unsigned max_fails, bool restore = false) {
         auto local_order = h.pos;
-        int fails = 0;
+        unsigned fails = 0;
 
-        for (int i = 0; ; ++i) {
+        int i = 0;
+        for (; ; ++i) {
+            check_cancelled(cancel);
 
             barycenter(h, i);   
 
@@ -178,9 +288,12 @@ private:
                 local_min = cross;
             } else {
                 fails++;
+                if (restore) {
+                    set_order(h, local_order);
+                }
             }
 
-            if (fails >= forgiveness) {
+            if (fails >= max_fails) {
                 break;
             }
         }
@@ -190,10 +303,10 @@ private:
             min_cross = local_min;
         }
 
-#ifdef REPORTING
-        report::iters += i;
-        report::random_final.push_back(local_min);
-#endif
+        if (stats) {
+            stats->crossing_iters += i + 1;
+            stats->run_crossings.push_back(local_min);
+        }
     }
 
     void barycenter(hierarchy& h, int i) {
@@ -243,10 +356,11 @@ private:
         bool improved = true;
         int k = 0;
         while (improved) {
+            check_cancelled(cancel);
             improved = false;
             
             for (auto& layer : h.layers) {
-                for (int i = 0; i < layer.size() - 1; ++i) {
+                for (int i = 0; i < static_cast<int>(layer.size()) - 1; ++i) {
                     int old = crossing_number(h, layer[i], layer[i + 1]);
                     int next = crossing_number(h, layer[i + 1], layer[i]);
                     
@@ -258,6 +372,9 @@ private:
             }
             k++;
         }
+        if (stats) {
+            stats->transpose_passes += k;
+        }
     }
 
     void fast_transpose(hierarchy& h) {
@@ -267,11 +384,12 @@ private:
         bool improved = true;
         int iters = 0;
         while (improved) {
+            check_cancelled(cancel);
             iters++;
             improved = false;
             for (auto& layer : h.layers) {
                 assert(layer.size() >= 1);
-                for (int i = 0; i < layer.size() - 1; ++i) {
+                for (int i = 0; i < static_cast<int>(layer.size()) - 1; ++i) {
                     if (eligible.at( layer[i] )) {
                         int old = crossing_number(h, layer[i], layer[i + 1]);
                         int next = crossing_number(h, layer[i + 1], layer[i]);
@@ -296,6 +414,9 @@ private:
                 }
             }
         }
+        if (stats) {
+            stats->transpose_passes += iters;
+        }
     }
 
 };
@@ -1,18 +1,69 @@
 #pragma once
 
 #include <vector>
+#include <memory_resource>
 #include <iostream>
 #include <ostream>
 #include <algorithm>
+#include <utility>
 
 #include "utils.hpp"
 #include "types.hpp"
 
 /**
  * Basic clas for representing a directed graph.
+ * 
+ * The lists of neighbours are allocated from the memory resource given to the constructor,
+ * or from the default resource if none is given. Copies made by the copy constructor use the default resource.
  */
 class graph {
 public:
+    graph() = default;
+
+    /**
+     * Create an empty graph whose lists of neighbours are allocated from <resource>.
+     */
+    explicit graph(std::pmr::memory_resource* resource)
+        : m_out_neighbours(resource)
+        , m_in_neighbours(resource) {}
+
+    /**
+     * Create a copy of <other> allocated from <resource>.
+     */
+    graph(const graph& other, std::pmr::memory_resource* resource)
+        : m_out_neighbours(other.m_out_neighbours, resource)
+        , m_in_neighbours(other.m_in_neighbours, resource) {}
+
+    /**
+     * Create a graph with vertices [0, n-1] and the given edges.
+     * 
+     * Faster than adding the edges one by one, since each list of neighbours is allocated just once.
+     * The neighbours are in the same order as if the edges were added one by one.
+     * 
+     * @param n     the number of vertices
+     * @param edges the edges as pairs of identifiers
+     * @param resource the memory resource for the lists of neighbours
+     */
+    graph(unsigned n, const std::vector< std::pair<vertex_t, vertex_t> >& edges,
+          std::pmr::memory_resource* resource = std::pmr::get_default_resource()) 
+        : m_out_neighbours(n, resource)
+        , m_in_neighbours(n, resource)
+    {
+        std::vector<unsigned> out_degree(n, 0);
+        std::vector<unsigned> in_degree(n, 0);
+        for (auto [ u, v ] : edges) {
+            ++out_degree[u];
+            ++in_degree[v];
+        }
+        for (vertex_t u = 0; u < n; ++u) {
+            m_out_neighbours[u].reserve(out_degree[u]);
+            m_in_neighbours[u].reserve(in_degree[u]);
+        }
+        for (auto [ u, v ] : edges) {
+            add_edge(u, v);
+        }
+    }
+
 
     /**
      * Add a new vertex to the graph.
@@ -49,14 +100,19 @@ public:
      */
     unsigned size() const { return m_out_neighbours.size(); }
 
+    /**
+     * Get the memory resource from which the graph is allocated.
+     */
+    std::pmr::memory_resource* resource() const { return m_out_neighbours.get_allocator().resource(); }
+
     /**
      * Get an immutable list of all successors.
      */
-    const std::vector<vertex_t>& out_neighbours(vertex_t u) const { return m_out_neighbours[u]; }
+    const std::pmr::vector<vertex_t>& out_neighbours(vertex_t u) const { return m_out_neighbours[u]; }
     /**
      * Get an immutable list of all predecessors.
      */
-    const std::vector<vertex_t>& in_neighbours(vertex_t u) const { return m_in_neighbours[u]; }
+    const std::pmr::vector<vertex_t>& in_neighbours(vertex_t u) const { return m_in_neighbours[u]; }
    
     /**
      * Get an implementation defined object which can be used for iterating through the vertices.
@@ -75,6 +131,50 @@ public:
         remove_neighour(m_in_neighbours[to], from);
     }
 
+    /**
+     * Remove the given vertices together with all their edges.
+     * The identifiers of the remaining vertices are decreased to close the gaps, so their order is preserved.
+     *
+     * @param removed the identifiers of the vertices to be removed
+     * @return the new identifier of each original vertex, or removed_vertex if it was removed
+     */
+    std::vector<vertex_t> remove_nodes(const std::vector<vertex_t>& removed) {
+        std::vector<vertex_t> new_id(size(), 0);
+        for (auto u : removed) {
+            new_id[u] = removed_vertex;
+        }
+        vertex_t next = 0;
+        for (auto& id : new_id) {
+            if (id != removed_vertex) {
+                id = next++;
+            }
+        }
+
+        auto update = [&new_id] (std::pmr::vector<vertex_t>& neighbours) {
+            auto end = std::remove_if(neighbours.begin(), neighbours.end(), [&new_id] (vertex_t v) { return new_id[v] == removed_vertex; });
+            neighbours.erase(end, neighbours.end());
+            for (auto& v : neighbours) {
+                v = new_id[v];
+            }
+        };
+        for (auto u : vertices()) {
+            if (new_id[u] != removed_vertex) {
+                update(m_out_neighbours[u]);
+                update(m_in_neighbours[u]);
+                if (new_id[u] != u) {
+                    m_out_neighbours[ new_id[u] ] = std::move(m_out_neighbours[u]);
+                    m_in_neighbours[ new_id[u] ] = std::move(m_in_neighbours[u]);
+                }
+            }
+        }
+        m_out_neighbours.resize(next);
+        m_in_neighbours.resize(next);
+
+        return new_id;
+    }
+
+    static constexpr vertex_t removed_vertex = static_cast<vertex_t>(-1);
+
     friend std::ostream& operator<<(std::ostream& out, const graph& g) {
         for (auto u : g.vertices()) {
             out << u << ": [";
@@ -91,10 +191,10 @@ public:
     }
 
 private:
-    std::vector< std::vector<vertex_t> > m_out_neighbours;
-    std::vector< std::vector<vertex_t> > m_in_neighbours;
+    std::pmr::vector< std::pmr::vector<vertex_t> > m_out_neighbours;
+    std::pmr::vector< std::pmr::vector<vertex_t> > m_in_neighbours;
 
-    void remove_neighour(std::vector<vertex_t>& neighbours, vertex_t u) {
+    void remove_neighour(std::pmr::vector<vertex_t>& neighbours, vertex_t u) {
         auto it = std::find(neighbours.begin(), neighbours.end(), u);
         if (it != neighbours.end()) {
             neighbours.erase(it);
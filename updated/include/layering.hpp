@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vector>
+#include <memory_resource>
 #include <cmath>
 #include <limits>
 #include <utility>
@@ -9,6 +10,7 @@
 
 #include "subgraph.hpp"
 #include "report.hpp"
+#include "cancellation.hpp"
 
 namespace detail {
 
@@ -23,11 +25,11 @@ namespace detail {
 struct hierarchy {
     vertex_map<int> ranking;
     vertex_map<int> pos;
-    std::vector< std::vector<vertex_t> > layers;
+    std::pmr::vector< std::pmr::vector<vertex_t> > layers;
     subgraph& g;
 
     hierarchy(subgraph& g) : hierarchy(g, -1) {}
-    hierarchy(subgraph& g, int val) : ranking(g, val), g(g) {}
+    hierarchy(subgraph& g, int val) : ranking(g, val), pos(g.resource()), layers(g.resource()), g(g) {}
 
     /**
      * Calculates the span of an edge - the number of layers the edge crosses.
@@ -39,8 +41,8 @@ struct hierarchy {
     int size() const { return layers.size(); }
 
     // get the layer of the given vertex
-    std::vector<vertex_t>& layer(vertex_t u) { return layers[ranking[u]]; }
-    const std::vector<vertex_t>& layer(vertex_t u) const { return layers[ranking[u]]; }
+    std::pmr::vector<vertex_t>& layer(vertex_t u) { return layers[ranking[u]]; }
+    const std::pmr::vector<vertex_t>& layer(vertex_t u) const { return layers[ranking[u]]; }
 
     // recalculate positions according to the current layers
     void update_pos() {
@@ -57,7 +59,7 @@ struct hierarchy {
     vertex_t prev(vertex_t u) const { return layers[ ranking[u] ][ pos[u] - 1 ]; }
 
     // true iff u has a successor/predecessor on its layer
-    bool has_next(vertex_t u) const { return pos[u] < layer(u).size() - 1; }
+    bool has_next(vertex_t u) const { return pos[u] < static_cast<int>(layer(u).size()) - 1; }
     bool has_prev(vertex_t u) const { return pos[u] > 0; }
 
     // Swap two vertices. Updates all necessary attributes.
@@ -71,7 +73,7 @@ struct hierarchy {
 
     // is i a valid index in the given layer?
     bool valid_pos(int layer_idx, int i) const {
-        return i >= 0 && i < layers[layer_idx].size();
+        return i >= 0 && i < static_cast<int>(layers[layer_idx].size());
     }
 };
 
@@ -108,10 +110,10 @@ std::ostream& operator<<(std::ostream& out, const hierarchy& h) {
  */
 struct long_edge {
     edge orig;
-    std::vector<vertex_t> path;
+    std::pmr::vector<vertex_t> path;
 
     /* so emplace_back can be used */
-    long_edge(edge orig, std::vector<vertex_t> path) : orig(orig), path(std::move(path)) {}
+    long_edge(edge orig, std::pmr::vector<vertex_t> path) : orig(orig), path(std::move(path)) {}
 };
 
 /**
@@ -121,15 +123,15 @@ struct long_edge {
  * 
  * @return list of edges which had to be split
  */
-std::vector< long_edge > add_dummy_nodes(hierarchy& h) {
-    std::vector< long_edge > split_edges;
+std::pmr::vector< long_edge > add_dummy_nodes(hierarchy& h) {
+    std::pmr::vector< long_edge > split_edges(h.g.resource());
 
     // find edges to be split
     for (auto u : h.g.vertices()) {
         for (auto v : h.g.out_neighbours(u)) {
             int span = h.span(u, v);
             if (span > 1) {
-                split_edges.emplace_back( edge{u, v}, std::vector<vertex_t>{} );
+                split_edges.emplace_back( edge{u, v}, std::pmr::vector<vertex_t>(h.g.resource()) );
             }
         }
     }
@@ -171,7 +173,18 @@ std::vector< long_edge > add_dummy_nodes(hierarchy& h) {
  */
 struct layering {
     virtual hierarchy run(detail::subgraph&) = 0;
+
+    /**
+     * Constructs a hierarchy close to the hinted ranks of the vertices, for example the ranks from a previous layout.
+     * By default the hints are ignored and run() is used.
+     */
+    virtual hierarchy refine(detail::subgraph& g, const layout_hints&) { return run(g); }
+
     virtual ~layering() = default;
+
+    component_stats* stats = nullptr;      /**< statistics of the component being processed, if collected */
+    std::vector<vertex_t>* parents = nullptr; /**< if set, receives the parents of the vertices in the final spanning tree, see layout_hints */
+    const cancellation_token* cancel = nullptr; /**< checked regularly if set */
 };
 
 
@@ -187,17 +200,30 @@ std::ostream& operator<<(std::ostream& out, tree_edge e) {
 
 
 struct tree_node {
+    using allocator_type = std::pmr::polymorphic_allocator<vertex_t>;
+
     std::optional<vertex_t> parent = std::nullopt;
-    vertex_t u;
+    vertex_t u = 0;
 
     int cut_value = 0;
     int out_cut_value = 0;
 
-    std::vector<vertex_t> children;
+    std::pmr::vector<vertex_t> children;
 
     // for marking the order of nodes using pre-order traversal
-    int min; 
-    int order;
+    int min = 0; 
+    int order = 0;
+
+    // allocator aware, so that the children are allocated from the resource of the vertex map holding the node
+    tree_node() = default;
+    tree_node(const tree_node&) = default;
+    tree_node(tree_node&&) = default;
+    tree_node& operator=(const tree_node&) = default;
+    tree_node& operator=(tree_node&&) = default;
+
+    explicit tree_node(const allocator_type& alloc) : children(alloc) {}
+    tree_node(const tree_node& other, const allocator_type& alloc) : children(alloc) { *this = other; }
+    tree_node(tree_node&& other, const allocator_type& alloc) : children(alloc) { *this = std::move(other); }
 };
 
 
@@ -214,8 +240,8 @@ struct tight_tree {
         }
     }
 
-    std::vector<vertex_t>& children(vertex_t u) { return nodes[u].children; }
-    const std::vector<vertex_t>& children(vertex_t u) const { return nodes[u].children; }
+    std::pmr::vector<vertex_t>& children(vertex_t u) { return nodes[u].children; }
+    const std::pmr::vector<vertex_t>& children(vertex_t u) const { return nodes[u].children; }
 
     vertex_t parent(vertex_t u) const { return *nodes[u].parent; }
 
@@ -363,7 +389,7 @@ struct tight_tree {
  * Network simple algorithm for layering a graph.
  */
 class network_simplex_layering : public layering {
-    tight_tree tree;
+    std::optional<tight_tree> tree; // exists only during optimize(), since it is allocated from the resource of the graph
 
 public:
 
@@ -372,8 +398,32 @@ public:
             return hierarchy(g);
         }
         auto h = init_hierarchy(g);
+        optimize(g, h);
+        return h;
+    }
+
+    /**
+     * Repairs the hinted ranks so that every edge points to a higher layer and then optimizes them.
+     * The initial tight tree reuses the hinted tree edges which are still tight, so when the hints come from 
+     * a slightly different graph, the pivoting resumes from almost the final tree of the previous run.
+     */
+    hierarchy refine(subgraph& g, const layout_hints& hints) override {
+        if (g.size() == 0) {
+            return hierarchy(g);
+        }
+        auto h = repair_ranking(g, hints.ranks);
+        optimize(g, h, &hints.parents);
+        return h;
+    }
+
+private:
 
-        init_tree(h);
+    void optimize(subgraph& g, hierarchy& h, const std::vector<vertex_t>* hinted_parents = nullptr) {
+        if (hinted_parents) {
+            init_tree(h, *hinted_parents);
+        } else {
+            init_tree(h);
+        }
         init_cut_values();
 
         optimize_edge_length(g, h);
@@ -381,18 +431,21 @@ public:
 #ifdef DEBUG_LABELS
         for (int i = 0; i < g.size(); ++i) {
             debug_labels[i] = std::to_string(i) + "(" +
-                        std::to_string(tree.node(i).parent ? *tree.node(i).parent : -1) + ", " +
-                        std::to_string(tree.node(i).cut_value) + ")";
+                        std::to_string(tree->node(i).parent ? *tree->node(i).parent : -1) + ", " +
+                        std::to_string(tree->node(i).cut_value) + ")";
         }
 #endif
 
-        calculate_layers(h);
+        if (parents) {
+            for (auto u : g.vertices()) {
+                (*parents)[u] = u == tree->root ? u : tree->parent(u);
+            }
+        }
 
-        return h;
+        calculate_layers(h);
+        tree.reset();
     }
 
-private:
-
     void  calculate_layers(hierarchy& h) {
         int min = std::numeric_limits<int>::max();
         int max = std::numeric_limits<int>::min();
@@ -455,6 +508,53 @@ private:
         return h;
     }
 
+    /**
+     * Assigns each vertex the lowest rank which is at least its given rank and higher than the ranks of its predecessors.
+     * Vertices without a given rank and without predecessors get the lowest of the given ranks.
+     * Like init_hierarchy, the result is not normalized.
+     */
+    hierarchy repair_ranking(subgraph& g, const std::vector<int>& ranks) {
+        auto given = [&ranks] (vertex_t u) { return u < ranks.size() && ranks[u] != layout_hints::no_rank; };
+
+        int lowest = std::numeric_limits<int>::max();
+        for (auto u : g.vertices()) {
+            if (given(u)) {
+                lowest = std::min(lowest, ranks[u]);
+            }
+        }
+        if (lowest == std::numeric_limits<int>::max()) {
+            lowest = 0;
+        }
+
+        // process the vertices in topological order
+        hierarchy h(g, -1);
+        vertex_map<unsigned> unranked_preds(g, 0);
+        std::vector<vertex_t> ready;
+        for (auto u : g.vertices()) {
+            unranked_preds[u] = g.in_neighbours(u).size();
+            if (unranked_preds[u] == 0) {
+                ready.push_back(u);
+            }
+        }
+        while (!ready.empty()) {
+            vertex_t u = ready.back();
+            ready.pop_back();
+
+            int rank = given(u) ? ranks[u] : layout_hints::no_rank;
+            for (auto v : g.in_neighbours(u)) {
+                rank = std::max(rank, h.ranking[v] + 1);
+            }
+            h.ranking[u] = rank == layout_hints::no_rank ? lowest : rank;
+
+            for (auto v : g.out_neighbours(u)) {
+                if (--unranked_preds[v] == 0) {
+                    ready.push_back(v);
+                }
+            }
+        }
+        return h;
+    }
+
     /**
      * Constructs a tree of all vertices
      * reachable from the root through tight edges. 
@@ -466,7 +566,7 @@ private:
         for ( auto u : h.g.neighbours(root) ) {
             int span = h.span(root, u);
             if ( !done.at(u) && std::abs(span) == 1 ) {
-                tree.add_child(root, u);
+                tree->add_child(root, u);
                 added += basic_tree(done, h, u);
             }
         }
@@ -484,12 +584,13 @@ private:
      */
     void init_tree(hierarchy& h) {
         const subgraph& g = h.g;
-        tree = tight_tree( &h, g.vertex(0) );
+        tree.emplace( &h, g.vertex(0) );
         vertex_map<bool> done(g, false);
 
-        int finished = basic_tree(done, h, tree.root);
+        unsigned finished = basic_tree(done, h, tree->root);
 
         while(finished < g.size()) {
+            check_cancelled(cancel);
             // in the underlying undirected graph find edge (u, v) with the smallest span
             // such that u is already in the tree and v is not in the tree
             edge e = { 0, 0 };
@@ -514,25 +615,93 @@ private:
                     h.ranking[u] += min_span;
                 }
             }
-            tree.add_child(e.from, e.to);
+            tree->add_child(e.from, e.to);
             done.set(e.to, true);
             ++finished;
         }
 
-        tree.postorder_search(tree.root, 0);
+        tree->postorder_search(tree->root, 0);
+    }
+
+
+    /**
+     * Like init_tree(hierarchy&), but prefers the tight edges between the vertices and their <hinted_parents>.
+     */
+    void init_tree(hierarchy& h, const std::vector<vertex_t>& hinted_parents) {
+        const subgraph& g = h.g;
+        tree.emplace( &h, g.vertex(0) );
+        vertex_map<bool> done(g, false);
+        std::vector<vertex_t> added;
+
+        grow_tree(done, h, tree->root, hinted_parents, added);
+        while (added.size() < g.size()) {
+            check_cancelled(cancel);
+            edge e = { 0, 0 };
+            int min_span = std::numeric_limits<int>::max();
+            for ( auto u : added ) {
+                for ( auto v : g.neighbours(u) ) {
+                    int span = h.span(u, v);
+                    if ( !done.at(v) && std::abs(span) < std::abs(min_span) ) {
+                        e = { u, v };
+                        min_span = span;
+                    }
+                }
+            }
+
+            min_span -= sgn(min_span);
+            for (auto u : added) {
+                h.ranking[u] += min_span;
+            }
+            tree->add_child(e.from, e.to);
+            grow_tree(done, h, e.to, hinted_parents, added);
+        }
+
+        tree->postorder_search(tree->root, 0);
+    }
+
+    /**
+     * Adds <u> and all vertices reachable from it through tight edges into the tree.
+     * Whenever a vertex is added, the hinted tree edges leaving it are followed first.
+     */
+    void grow_tree(vertex_map<bool>& done, const hierarchy& h, vertex_t u, 
+                   const std::vector<vertex_t>& hinted_parents, std::vector<vertex_t>& added) {
+        std::size_t i = added.size();
+        add_hinted(done, h, u, hinted_parents, added);
+        for (; i < added.size(); ++i) {
+            vertex_t x = added[i];
+            for ( auto v : h.g.neighbours(x) ) {
+                if ( !done.at(v) && std::abs(h.span(x, v)) == 1 ) {
+                    tree->add_child(x, v);
+                    add_hinted(done, h, v, hinted_parents, added);
+                }
+            }
+        }
     }
 
+    void add_hinted(vertex_map<bool>& done, const hierarchy& h, vertex_t u, 
+                    const std::vector<vertex_t>& hinted_parents, std::vector<vertex_t>& added) {
+        done.set(u, true);
+        added.push_back(u);
+
+        auto parent = [&hinted_parents] (vertex_t x) { return x < hinted_parents.size() ? hinted_parents[x] : x; };
+        for ( auto v : h.g.neighbours(u) ) {
+            if ( !done.at(v) && (parent(v) == u || parent(u) == v) && std::abs(h.span(u, v)) == 1 ) {
+                tree->add_child(u, v);
+                add_hinted(done, h, v, hinted_parents, added);
+            }
+        }
+    }
 
     // Calculates the initial cut values of all edges in the tight tree.
     void init_cut_values() {
-        for ( auto child : tree.children(tree.root) ) {
-            init_cut_values(tree.root, child);
+        for ( auto child : tree->children(tree->root) ) {
+            init_cut_values(tree->root, child);
         }
     }
 
     // Calculates cut values of all edges in the subtree rooted at <v> and then the cut value of (<u>, <v>).
     void init_cut_values(vertex_t u, vertex_t v) {
-        for (auto child : tree.children(v)) {
+        for (auto child : tree->children(v)) {
             init_cut_values(v, child);
         }
         set_cut_value(u, v);
@@ -543,41 +712,41 @@ private:
      * Requires the cut values of the edges between <v> and its children to be already calculated.
      */
     void set_cut_value(vertex_t u, vertex_t v) {
-        subgraph& g = tree.h->g;
+        subgraph& g = tree->h->g;
         int val = 0;
 
-        for (auto child : tree.children(v)) {
-            val += tree.dir(u, v) * tree.dir(v, child) * tree.out_cut_val(v, child);
+        for (auto child : tree->children(v)) {
+            val += tree->dir(u, v) * tree->dir(v, child) * tree->out_cut_val(v, child);
         }
 
         for (auto x : g.neighbours(v)) {
-            if (tree.component( {u, v}, x ) == u) {
-                val += tree.dir(x, v) * tree.dir(u, v);
+            if (tree->component( {u, v}, x ) == u) {
+                val += tree->dir(x, v) * tree->dir(u, v);
             }
         }
-        tree.cut_val(u, v, val);
+        tree->cut_val(u, v, val);
 
         for (auto x : g.neighbours(u)) {
-            if (tree.component( {u, v}, x ) == v) {
-                val -= tree.dir(u, x) * tree.dir(u, v);
+            if (tree->component( {u, v}, x ) == v) {
+                val -= tree->dir(u, x) * tree->dir(u, v);
             }
         }
-        tree.out_cut_val(u, v, val);  
+        tree->out_cut_val(u, v, val);  
     }
 
     void switch_tree_edges(tree_edge orig, tree_edge entering) {
-        auto ancestor = tree.common_acestor(entering.u, entering.v);
+        auto ancestor = tree->common_acestor(entering.u, entering.v);
 
-        tree.swap_edges({entering.u, entering.v},{orig.u, orig.v});
+        tree->swap_edges({entering.u, entering.v},{orig.u, orig.v});
 
-        tree.postorder_search(ancestor, tree.node(ancestor).min);
+        tree->postorder_search(ancestor, tree->node(ancestor).min);
         fix_cut_values(ancestor, orig.u);
         fix_cut_values(ancestor, orig.v);
     }
 
     void fix_cut_values(vertex_t root, vertex_t u) {
         while (u != root) {
-            vertex_t parent = *tree.node(u).parent;
+            vertex_t parent = *tree->node(u).parent;
             set_cut_value(parent, u);
             u = parent;
         }
@@ -585,7 +754,7 @@ private:
 
     void move_subtree(hierarchy& h, vertex_t root, int d) {
         h.ranking[root] += d;
-        for (auto child : tree.children(root)) {
+        for (auto child : tree->children(root)) {
             move_subtree(h, child, d);
         }
     }
@@ -598,11 +767,11 @@ private:
         vertex_t end_component = start_component == leaving.u ? leaving.v : leaving.u;
 
         for (auto u : g.vertices()) {
-            if (tree.component({leaving.u, leaving.v}, u) != start_component)
+            if (tree->component({leaving.u, leaving.v}, u) != start_component)
                 continue;
 
             for (auto v : g.out_neighbours(u)) {
-                if (tree.component({leaving.u, leaving.v}, v) == end_component && h.span(u, v) < span) {
+                if (tree->component({leaving.u, leaving.v}, v) == end_component && h.span(u, v) < span) {
                     entering.u = entering.dir == 1 ? u : v;
                     entering.v = entering.dir == 1 ? v : u;
                     span = h.span(u, v);
@@ -618,10 +787,10 @@ private:
     std::optional<tree_edge> find_leaving_edge(hierarchy& h) {
         for (auto u : h.g.vertices()) {
             for (auto v : h.g.out_neighbours(u)) {
-                if (v != tree.root && tree.parent(v) == u && tree.node(v).cut_value < 0) {
+                if (v != tree->root && tree->parent(v) == u && tree->node(v).cut_value < 0) {
                     return tree_edge{ u, v, 1 };
                 }
-                if (u != tree.root && tree.parent(u) == v && tree.node(u).cut_value < 0) {
+                if (u != tree->root && tree->parent(u) == v && tree->node(u).cut_value < 0) {
                     return tree_edge{ v, u, -1 };
                 }
             }
@@ -634,6 +803,7 @@ private:
         int iters = 0;
 
         while(true) {
+            check_cancelled(cancel);
             auto leaving = find_leaving_edge(h);
             if (!leaving)
                 break;
@@ -649,9 +819,9 @@ private:
             iters++;
         }
 
-#ifdef REPORTING
-        report::simplex::iters = iters;
-#endif
+        if (stats) {
+            stats->simplex_iters = iters;
+        }
     }
 
 };
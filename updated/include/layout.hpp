@@ -5,6 +5,14 @@
 
 #include <vector>
 #include <memory>
+#include <memory_resource>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <future>
+#include <limits>
+#include <optional>
+#include <stdexcept>
 
 #include "interface.hpp"
 #include "subgraph.hpp"
@@ -14,19 +22,96 @@
 #include "positioning.hpp"
 #include "crossing.hpp"
 #include "router.hpp"
+#include "report.hpp"
+#include "cancellation.hpp"
 
 #ifdef CONTROL_CROSSING
 bool crossing_enabled = true;
 #endif
 
 
+/**
+ * Receives a notification before and after each stage of the layout, for example to measure the stages.
+ */
+struct stage_observer {
+    virtual ~stage_observer() = default;
+    virtual void begin(layout_stage) {}
+    virtual void end(layout_stage) {}
+
+    /**
+     * Called before the stages of the component with the given index out of <count> components.
+     */
+    virtual void begin_component(unsigned /*index*/, unsigned /*count*/) {}
+};
+
+
+/**
+ * A batch of changes to the graph of a layout, see sugiyama_layout::update().
+ *
+ * The edges are removed first, then the edges are added and finally the vertices are removed.
+ * All the identifiers refer to the graph before the vertices are removed, 
+ * the added vertices having the identifiers following the existing ones.
+ */
+struct graph_edit {
+    unsigned added_vertices = 0;                                       /**< number of new vertices */
+    std::vector< std::pair<vertex_t, vertex_t> > added_edges;          /**< new edges */
+    std::vector< std::pair<vertex_t, vertex_t> > removed_edges;        /**< existing edges to be removed */
+    std::vector< vertex_t > removed_vertices;                          /**< vertices to be removed together with their edges */
+};
+
+
 class sugiyama_layout {
 public:
-    sugiyama_layout(graph g) : g(g), original_vertex_count(g.size()) { build(); }
+    sugiyama_layout(graph g) : source(std::move(g)), original_vertex_count(source.size()) { build(); }
 
     sugiyama_layout(graph g, attributes attr) 
-        : g(g)
-        , original_vertex_count(g.size())
+        : source(std::move(g))
+        , original_vertex_count(source.size())
+        , attrs(attr) { build(); }
+
+    /**
+     * Creates the layout and notifies <observer> about each of its stages.
+     */
+    sugiyama_layout(graph g, attributes attr, stage_observer& observer) 
+        : source(std::move(g))
+        , original_vertex_count(source.size())
+        , attrs(attr)
+        , observer(&observer) { build(); }
+
+    /**
+     * Creates the layout, notifying <observer> about its stages if it is not null.
+     * Once <token> is cancelled, the layout stops at the next check and the constructor throws layout_cancelled.
+     */
+    sugiyama_layout(graph g, attributes attr, stage_observer* observer, cancellation_token token) 
+        : source(std::move(g))
+        , original_vertex_count(source.size())
+        , attrs(attr)
+        , observer(observer)
+        , token(std::move(token)) { build(); }
+
+    /**
+     * Creates the layout starting from <hints>, for example the hints() of a previous layout of a similar graph.
+     * The layering starts from the hinted ranks, repaired where they violate an edge.
+     * The vertices on each layer are first sorted by the hinted order which the crossing reduction then only improves locally,
+     * so the result stays close to the hints.
+     */
+    sugiyama_layout(graph g, attributes attr, layout_hints hints) 
+        : source(std::move(g))
+        , original_vertex_count(source.size())
+        , attrs(attr)
+        , warm_start(std::move(hints)) { build(); warm_start = {}; }
+
+    /**
+     * Creates the layout, taking the memory for its temporary structures from <resource>.
+     * The temporary structures (the copy of the graph with the dummy vertices, the hierarchy, the vertex maps etc.)
+     * are allocated from a pool which is released at once when the layout is finished. 
+     * The pool takes its memory from <resource> in large chunks, so <resource> has to outlive the layout.
+     * The results are allocated from the default resource.
+     */
+    sugiyama_layout(graph g, attributes attr, std::pmr::memory_resource* resource) 
+        : source(std::move(g))
+        , arena(resource)
+        , original_vertex_count(source.size())
         , attrs(attr) { build(); }
 
     /**
@@ -36,17 +121,173 @@ public:
 
     /**
      * Returns the control points for all the edges in the graph.
+     * Empty if the layout was created with attributes::produce_flat_paths set.
      */
     const std::vector<path>& edges() const { return paths; }
 
+    /**
+     * Returns the edges with their control points stored in one contiguous buffer.
+     * Empty unless the layout was created with attributes::produce_flat_paths set.
+     */
+    const flat_paths& flat_edges() const { return flat; }
+
     float width() const { return size.x; }
     float height() const { return size.y; }
     vec2 dimensions() const { return size; } 
 
     const attributes& attribs() const { return attrs; }
 
+    /**
+     * Returns the statistics about the layout, or nullptr unless it was created with attributes::collect_stats set.
+     */
+    const layout_stats* stats() const { return stats_data.get(); }
+
+    /**
+     * Returns the layers and the x coordinates of the vertices, usable as hints for laying out a similar graph.
+     */
+    layout_hints hints() const {
+        layout_hints res;
+        float layer_height = 2*attrs.node_size + attrs.layer_dist;
+        for (const auto& n : nodes) {
+            res.ranks.push_back( std::lround((n.pos.y - attrs.node_size)/layer_height) );
+            res.order.push_back( n.pos.x );
+        }
+        res.parents = tree_parents;
+        return res;
+    }
+
+    /**
+     * Returns the graph of the layout.
+     */
+    const graph& input() const { return source; }
+
+    /**
+     * Changes the graph of the layout and lays out again only the connected components affected by the change.
+     * The drawings of the other components are kept, they are only moved horizontally to make room for the changed ones.
+     * The layering and the crossing reduction of the changed components start from the previous layers and order of the vertices.
+     * The identifiers of the vertices change as described in graph::remove_nodes() if any vertices are removed.
+     *
+     * If statistics are collected, they describe only the work done by the update.
+     * Throws std::invalid_argument if the edit refers to missing vertices or edges or adds an existing edge,
+     * the layout is left unchanged in that case.
+     */
+    void update(const graph_edit& edit) {
+        if (source.size() != original_vertex_count) {
+            throw std::invalid_argument("The layout was not created from a graph and cannot be updated.");
+        }
+        check_edit(edit);
+        // a cancelled update would leave the layout inconsistent
+        token.reset();
+
+        // the components containing a touched vertex have to be laid out again
+        unsigned n = source.size() + edit.added_vertices;
+        std::vector<bool> touched(n, false);
+        for (unsigned i = 0; i < edit.added_vertices; ++i) {
+            touched[ source.add_node() ] = true;
+        }
+        for (auto [ u, v ] : edit.removed_edges) {
+            source.remove_edge(u, v);
+            touched[u] = touched[v] = true;
+        }
+        for (auto [ u, v ] : edit.added_edges) {
+            source.add_edge(u, v);
+            touched[u] = touched[v] = true;
+        }
+        for (auto u : edit.removed_vertices) {
+            for (auto v : source.out_neighbours(u)) touched[v] = true;
+            for (auto v : source.in_neighbours(u)) touched[v] = true;
+        }
+
+        std::vector<vertex_t> new_id = source.remove_nodes(edit.removed_vertices);
+        std::vector<vertex_t> old_id(source.size());
+        std::vector<bool> new_touched(source.size());
+        for (vertex_t u = 0; u < n; ++u) {
+            if (new_id[u] != graph::removed_vertex) {
+                old_id[ new_id[u] ] = u;
+                new_touched[ new_id[u] ] = touched[u];
+            }
+        }
+
+        // the previous layout is the starting point for the changed components
+        layout_hints prev_hints = hints();
+        warm_start.ranks.assign(source.size(), layout_hints::no_rank);
+        warm_start.order.assign(source.size(), std::numeric_limits<float>::quiet_NaN());
+        warm_start.parents.resize(source.size());
+        for (vertex_t u = 0; u < source.size(); ++u) {
+            warm_start.parents[u] = u;
+            if (old_id[u] < prev_hints.ranks.size()) {
+                warm_start.ranks[u] = prev_hints.ranks[ old_id[u] ];
+                warm_start.order[u] = prev_hints.order[ old_id[u] ];
+            }
+            if (old_id[u] < prev_hints.parents.size()) {
+                vertex_t parent = new_id[ prev_hints.parents[ old_id[u] ] ];
+                warm_start.parents[u] = parent == graph::removed_vertex ? u : parent;
+            }
+        }
+        // the unchanged components keep their trees
+        tree_parents = warm_start.parents;
+
+        previous_layout prev { std::move(nodes), std::move(paths), std::move(flat), std::move(components), std::move(component_of) };
+        nodes.clear();
+        paths.clear();
+        flat = {};
+        components.clear();
+        component_of.clear();
+
+        original_vertex_count = source.size();
+        reset_modules();
+        size = { 0, 0 };
+        if (stats_data) {
+            stats_data = std::make_unique<layout_stats>();
+            current_stats = nullptr;
+        }
+
+        run_scope scope(*this);
+        begin(layout_stage::split);
+        std::vector< detail::subgraph > subgraphs = detail::split(*g);
+        init_nodes();
+        end(layout_stage::split);
+
+        vec2 start { 0, 0 };
+        for (auto& sub : subgraphs) {
+            if (observer) observer->begin_component(components.size(), subgraphs.size());
+            std::size_t first_path = path_count();
+            vec2 dim;
+            if (std::none_of(sub.vertices().begin(), sub.vertices().end(), [&new_touched] (vertex_t u) { return new_touched[u]; })) {
+                dim = reuse_component(sub, prev, prev.component_of[ old_id[sub.vertex(0)] ], start, old_id, new_id);
+            } else {
+                dim = process_subgraph(sub, start);
+            }
+            add_component(sub, start, dim, first_path);
+        }
+
+        size.x -= attrs.node_dist;
+        nodes.resize(original_vertex_count);
+        warm_start = {};
+    }
+
 private:
-    graph g;
+    friend class layout_cache;
+
+    /**
+     * Creates a finished layout from previously computed results without running the algorithm.
+     */
+    sugiyama_layout(attributes attr, std::vector<node> nodes, std::vector<path> paths, flat_paths flat, vec2 size)
+        : original_vertex_count(nodes.size())
+        , nodes(std::move(nodes))
+        , paths(std::move(paths))
+        , flat(std::move(flat))
+        , size(size)
+        , attrs(attr) {}
+
+    graph source;   // the graph being laid out
+
+    // memory for the temporary structures of one run of the layout, released when the run ends;
+    // a pool rather than a monotonic buffer, since the vertex maps of the components are reallocated many times
+    std::pmr::unsynchronized_pool_resource arena;
+
+    // copy of the graph modified by the algorithm, for example by adding dummy vertices, exists only during a run
+    std::optional<graph> g;
     unsigned original_vertex_count;
 
     detail::vertex_map<detail::bounding_box> boxes;
@@ -54,11 +295,46 @@ private:
     // the final positions of vertices and control points of edges
     std::vector< node > nodes;
     std::vector< path > paths;
+    flat_paths flat;
     vec2 size = { 0, 0 };
 
     // attributes controling spacing
     attributes attrs;
 
+    // the part of the layout occupied by one connected component
+    struct component_layout {
+        float x;                // the left border
+        vec2 size;
+        std::size_t first_path; // index of the first path of the component in paths or flat.paths
+        std::size_t path_count;
+    };
+
+    std::vector< component_layout > components;
+    std::vector< unsigned > component_of;   // index of the component of each vertex
+
+    // the result of the layout before an update
+    struct previous_layout {
+        std::vector< node > nodes;
+        std::vector< path > paths;
+        flat_paths flat;
+        std::vector< component_layout > components;
+        std::vector< unsigned > component_of;
+    };
+
+    stage_observer* observer = nullptr;
+    std::optional<cancellation_token> token;
+
+    // hints for the ranks and the order of the vertices, empty if there are none
+    layout_hints warm_start;
+
+    // the parent of each vertex in the spanning tree found by the layering
+    std::vector<vertex_t> tree_parents;
+
+    // statistics are allocated only when they are collected
+    std::unique_ptr<layout_stats> stats_data = attrs.collect_stats ? std::make_unique<layout_stats>() : nullptr;
+    component_stats* current_stats = nullptr;
+    std::chrono::steady_clock::time_point stage_start;
+
     // algorithms for individual steps of sugiyama framework
     std::unique_ptr< detail::cycle_removal > cycle_module =     
                         std::make_unique< detail::dfs_removal >();
@@ -69,60 +345,260 @@ private:
     std::unique_ptr< detail::crossing_reduction > crossing_module = 
                         std::make_unique< detail::barycentric_heuristic >();
     
-    std::unique_ptr< detail::positioning > positioning_module = 
-                        std::make_unique< detail::fast_and_simple_positioning >(attrs, nodes, boxes);
+    std::unique_ptr< detail::positioning > positioning_module = make_positioning();
     
-    std::unique_ptr< detail::edge_router > routing_module = 
-                        std::make_unique< detail::router >(nodes, paths, attrs);
+    std::unique_ptr< detail::edge_router > routing_module = make_routing();
+
+
+    /**
+     * Replaces the modules by new ones, since they keep data about the vertices of the previous layout
+     * and the identifiers of the dummy vertices are reused.
+     */
+    void reset_modules() {
+        cycle_module = std::make_unique< detail::dfs_removal >();
+        layering_module = std::make_unique< detail::network_simplex_layering >();
+        crossing_module = std::make_unique< detail::barycentric_heuristic >();
+        positioning_module = make_positioning();
+        routing_module = make_routing();
+    }
+
+    std::unique_ptr< detail::positioning > make_positioning() {
+        if (attrs.positioning == positioning_method::single) {
+            return std::make_unique< detail::single_alignment_positioning >(attrs, nodes, boxes);
+        }
+        return std::make_unique< detail::fast_and_simple_positioning >(attrs, nodes, boxes);
+    }
 
+    std::unique_ptr< detail::edge_router > make_routing() {
+        if (attrs.routing == routing_method::spline) {
+            return std::make_unique< detail::spline_router >(nodes, paths, flat, attrs);
+        }
+        return std::make_unique< detail::router >(nodes, paths, flat, attrs);
+    }
+
+    void begin(layout_stage s) {
+        if (token) token->check();
+        if (observer) observer->begin(s);
+        if (stats_data) stage_start = std::chrono::steady_clock::now();
+    }
+
+    void end(layout_stage s) {
+        if (stats_data) {
+            auto micros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - stage_start).count();
+            stats_data->stage_micros[static_cast<int>(s)] += micros;
+            if (current_stats && s != layout_stage::split) {
+                current_stats->stage_micros[static_cast<int>(s)] += micros;
+            }
+        }
+        if (observer) observer->end(s);
+    }
+
+    /**
+     * Creates the working copy of the graph in the arena and releases the arena once the run ends, also by an exception.
+     * Has to be created before any other structure allocated from the arena, so that it is destroyed after all of them.
+     * The modules are destroyed too, since an interrupted run can leave them holding memory from the arena,
+     * update() creates new ones anyway.
+     */
+    struct run_scope {
+        sugiyama_layout& l;
+
+        run_scope(sugiyama_layout& l) : l(l) { l.g.emplace(l.source, &l.arena); }
+        ~run_scope() {
+            l.cycle_module.reset();
+            l.layering_module.reset();
+            l.crossing_module.reset();
+            l.positioning_module.reset();
+            l.routing_module.reset();
+            l.g.reset();
+            l.arena.release();
+        }
+    };
 
     void build() {
-        std::vector< detail::subgraph > subgraphs = detail::split(g);
+        run_scope scope(*this);
+        begin(layout_stage::split);
+        std::vector< detail::subgraph > subgraphs = detail::split(*g);
         init_nodes();
+        tree_parents.resize(original_vertex_count);
+        end(layout_stage::split);
 
         vec2 start { 0, 0 };
         for (auto& g : subgraphs) {
+            if (observer) observer->begin_component(components.size(), subgraphs.size());
+            std::size_t first_path = path_count();
             vec2 dim = process_subgraph(g, start);
-            start.x += dim.x + attrs.node_dist;
-            size.x += dim.x + attrs.node_dist;
-            size.y = std::max(size.y, dim.y);
+            add_component(g, start, dim, first_path);
         }
 
         size.x -= attrs.node_dist;
         nodes.resize(original_vertex_count);
     }
 
+    // true if any vertex of the component has a hinted rank
+    bool has_rank_hints(const detail::subgraph& g) const {
+        const auto& ranks = warm_start.ranks;
+        return std::any_of(g.vertices().begin(), g.vertices().end(), [&ranks] (vertex_t u) {
+            return u < ranks.size() && ranks[u] != layout_hints::no_rank;
+        });
+    }
+
+    // true if any vertex of the component has a hinted order
+    bool has_order_hints(const detail::subgraph& g) const {
+        const auto& order = warm_start.order;
+        return std::any_of(g.vertices().begin(), g.vertices().end(), [&order, &g] (vertex_t u) {
+            return !g.is_dummy(u) && u < order.size() && !std::isnan(order[u]);
+        });
+    }
+
+    std::size_t path_count() const { return attrs.produce_flat_paths ? flat.paths.size() : paths.size(); }
+
+    // records the component which was just placed at <start> and moves <start> behind it
+    void add_component(const detail::subgraph& g, vec2& start, vec2 dim, std::size_t first_path) {
+        component_of.resize(original_vertex_count);
+        for (auto u : g.vertices()) {
+            if (u < original_vertex_count) {
+                component_of[u] = components.size();
+            }
+        }
+        components.push_back({ start.x, dim, first_path, path_count() - first_path });
+
+        start.x += dim.x + attrs.node_dist;
+        size.x += dim.x + attrs.node_dist;
+        size.y = std::max(size.y, dim.y);
+    }
+
+    /**
+     * Copies the drawing of the unchanged component <c> of the previous layout, moving it to <start>.
+     */
+    vec2 reuse_component(const detail::subgraph& g, previous_layout& prev, unsigned c, vec2 start,
+                         const std::vector<vertex_t>& old_id, const std::vector<vertex_t>& new_id) {
+        const auto& comp = prev.components[c];
+        vec2 shift { start.x - comp.x, 0 };
+
+        for (auto u : g.vertices()) {
+            nodes[u] = prev.nodes[ old_id[u] ];
+            nodes[u].u = u;
+            nodes[u].pos += shift;
+        }
+
+        for (std::size_t i = comp.first_path; i < comp.first_path + comp.path_count; ++i) {
+            if (attrs.produce_flat_paths) {
+                flat_path p = prev.flat.paths[i];
+                auto points = prev.flat.points_of(p);
+                p.from = new_id[p.from];
+                p.to = new_id[p.to];
+                p.offset = flat.points.size();
+                for (auto point : points) {
+                    flat.points.push_back(point + shift);
+                }
+                flat.paths.push_back(p);
+            } else {
+                path p = std::move(prev.paths[i]);
+                p.from = new_id[p.from];
+                p.to = new_id[p.to];
+                for (auto& point : p.points) {
+                    point += shift;
+                }
+                paths.push_back(std::move(p));
+            }
+        }
+        return comp.size;
+    }
+
+    void check_edit(const graph_edit& edit) const {
+        unsigned n = source.size() + edit.added_vertices;
+        auto has_edge = [this] (vertex_t u, vertex_t v) {
+            if (u >= source.size() || v >= source.size()) {
+                return false;
+            }
+            const auto& out = source.out_neighbours(u);
+            return std::find(out.begin(), out.end(), v) != out.end();
+        };
+
+        for (auto [ u, v ] : edit.removed_edges) {
+            if (!has_edge(u, v)) {
+                throw std::invalid_argument("Removed edge (" + std::to_string(u) + ", " + std::to_string(v) + ") does not exist.");
+            }
+        }
+        for (auto [ u, v ] : edit.added_edges) {
+            bool removed = std::find(edit.removed_edges.begin(), edit.removed_edges.end(), std::pair{ u, v }) != edit.removed_edges.end();
+            bool repeated = std::count(edit.added_edges.begin(), edit.added_edges.end(), std::pair{ u, v }) > 1;
+            if (u >= n || v >= n || (has_edge(u, v) && !removed) || repeated) {
+                throw std::invalid_argument("Added edge (" + std::to_string(u) + ", " + std::to_string(v) + ") is invalid or exists.");
+            }
+        }
+        for (auto u : edit.removed_vertices) {
+            if (u >= n) {
+                throw std::invalid_argument("Removed vertex " + std::to_string(u) + " does not exist.");
+            }
+        }
+    }
+
 
     vec2 process_subgraph(detail::subgraph& g, vec2 start) {
+        if (stats_data) {
+            current_stats = &stats_data->components.emplace_back();
+            current_stats->vertices = g.size();
+        }
+        layering_module->stats = current_stats;
+        layering_module->parents = &tree_parents;
+
+        const cancellation_token* cancel = token ? &*token : nullptr;
+        layering_module->cancel = cancel;
+        crossing_module->cancel = cancel;
+        positioning_module->cancel = cancel;
+        crossing_module->stats = current_stats;
 
+        begin(layout_stage::cycle_removal);
         auto reversed_edges = cycle_module->run(g);
-        detail::hierarchy h = layering_module->run(g);
+        end(layout_stage::cycle_removal);
 
+        begin(layout_stage::layering);
+        detail::hierarchy h = has_rank_hints(g) ? layering_module->refine(g, warm_start) : layering_module->run(g);
+        end(layout_stage::layering);
+
+        begin(layout_stage::dummy_nodes);
         auto long_edges = add_dummy_nodes(h);
         update_reversed_edges(reversed_edges, long_edges);
+        unsigned vertex_count = nodes.size();
         update_dummy_nodes();
+        if (current_stats) {
+            current_stats->dummy_nodes = nodes.size() - vertex_count;
+        }
+        end(layout_stage::dummy_nodes);
         
+        begin(layout_stage::crossing_reduction);
 #ifdef CONTROL_CROSSING
         if (crossing_enabled) {
             crossing->run(h);    
         }
 #else
-        crossing_module->run(h);
+        if (has_order_hints(g)) {
+            detail::order_by_hints(h, detail::spread_hints(h, long_edges, warm_start.order));
+            crossing_module->refine(h);
+        } else {
+            crossing_module->run(h);
+        }
 #endif
-        enlarge_loop_boxes(reversed_edges);
+        end(layout_stage::crossing_reduction);
 
+        begin(layout_stage::positioning);
+        enlarge_loop_boxes(reversed_edges);
         vec2 dimensions = positioning_module->run(h, start);
+        end(layout_stage::positioning);
 
+        begin(layout_stage::routing);
         routing_module->run(h, reversed_edges);
+        end(layout_stage::routing);
 
         return dimensions;
     }
 
     void update_dummy_nodes() {
-        boxes.resize(g, { {0, 0}, { 0, 0} });
+        boxes.resize(*g, { {0, 0}, { 0, 0} });
         
         auto i = nodes.size();
-        nodes.resize(g.size());
+        nodes.resize(g->size());
         for (; i < nodes.size(); ++i) {
             nodes[i].u = i;
             nodes[i].size = 0;
@@ -138,9 +614,9 @@ private:
 
 
     void init_nodes() {
-        nodes.resize( g.size() );
-        boxes.resize( g );
-        for ( auto u : g.vertices() ) {
+        nodes.resize( g->size() );
+        boxes.resize( *g );
+        for ( auto u : g->vertices() ) {
             nodes[u].u = u;
             nodes[u].size = attrs.node_size;
             boxes[u] = { { 2*nodes[u].size, 2*nodes[u].size },
@@ -156,7 +632,7 @@ private:
      * When reversing the path back, the rest of the path can be easily determined by folowing the dummy nodes
      * until the first non-dummy node is reached.
      */
-    void update_reversed_edges(detail::feedback_set& reversed_edges, const std::vector< detail::long_edge >& long_edges) {
+    void update_reversed_edges(detail::feedback_set& reversed_edges, const std::pmr::vector< detail::long_edge >& long_edges) {
         for (const auto& elem : long_edges) {
             if (reversed_edges.reversed.remove(elem.orig)) {
                 reversed_edges.reversed.insert(elem.path[0], elem.path[1]);
@@ -168,4 +644,50 @@ private:
 };
 
 
+
+/**
+ * Receives the progress of a layout: the stage which is starting, 
+ * the index of the component being processed and the number of components (both 0 during the split stage).
+ */
+using progress_callback = std::function< void(layout_stage stage, unsigned component, unsigned components) >;
+
+namespace detail {
+
+struct progress_observer : stage_observer {
+    progress_callback progress;
+    unsigned component = 0;
+    unsigned components = 0;
+
+    progress_observer(progress_callback progress) : progress(std::move(progress)) {}
+
+    void begin_component(unsigned index, unsigned count) override {
+        component = index;
+        components = count;
+    }
+
+    void begin(layout_stage s) override {
+        if (progress) progress(s, component, components);
+    }
+};
+
+} // namespace detail
+
+/**
+ * Lays out the graph in a new thread.
+ * 
+ * <progress> is called from that thread at the start of each stage, so it has to be thread safe.
+ * Once <token> is cancelled, the layout stops soon and the returned future throws layout_cancelled.
+ * The long loops of the layering, the crossing reduction and the positioning check the token, the routing does not.
+ */
+inline std::future< std::shared_ptr<sugiyama_layout> > layout_async(graph g, attributes attr,
+                                                                   cancellation_token token = {},
+                                                                   progress_callback progress = {}) 
+{
+    return std::async(std::launch::async, [g = std::move(g), attr, token = std::move(token), progress = std::move(progress)] () mutable {
+        detail::progress_observer observer(std::move(progress));
+        return std::make_shared<sugiyama_layout>(std::move(g), attr, &observer, std::move(token));
+    });
+}
+
+
 #endif
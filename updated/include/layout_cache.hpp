@@ -0,0 +1,381 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <random>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "graph.hpp"
+#include "types.hpp"
+#include "layout.hpp"
+
+
+/**
+ * 128 bit fingerprint of the input of a layout, that is the graph and its attributes.
+ */
+struct layout_key {
+    uint64_t hi = 0;
+    uint64_t lo = 0;
+
+    bool operator==(const layout_key& other) const { return hi == other.hi && lo == other.lo; }
+    bool operator!=(const layout_key& other) const { return !(*this == other); }
+
+    /**
+     * Returns the key as 32 hexadecimal digits, used as the file name in the disk cache.
+     */
+    std::string str() const {
+        static const char digits[] = "0123456789abcdef";
+        std::string s(32, '0');
+        for (int i = 0; i < 16; ++i) {
+            s[15 - i] = digits[(hi >> (4*i)) & 0xf];
+            s[31 - i] = digits[(lo >> (4*i)) & 0xf];
+        }
+        return s;
+    }
+};
+
+
+namespace detail {
+
+/**
+ * Two 64 bit hashes computed by different algorithms: FNV-1a over the bytes of the input,
+ * and a multiply-xorshift mix (the finalizer of SplitMix64) applied to each 32 bit word.
+ * A collision of the whole key needs both of them to collide on the same inputs.
+ */
+class layout_hasher {
+public:
+    void add(uint32_t x) {
+        for (int i = 0; i < 4; ++i) {
+            unsigned char byte = (x >> (8*i)) & 0xff;
+            hi = (hi ^ byte) * 0x100000001b3ull;
+        }
+        lo = mix(lo + x + 0x9e3779b97f4a7c15ull);
+    }
+
+    void add(float x) {
+        uint32_t bits;
+        std::memcpy(&bits, &x, sizeof(bits));
+        add(bits);
+    }
+
+    layout_key key() const { return { hi, lo }; }
+
+private:
+    uint64_t hi = 0xcbf29ce484222325ull;
+    uint64_t lo = 0;
+
+    static uint64_t mix(uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+};
+
+struct layout_key_hash {
+    std::size_t operator()(const layout_key& k) const { return k.lo ^ (k.hi * 31); }
+};
+
+} // namespace detail
+
+
+/**
+ * Computes the key of the layout of <g> with attributes <attr>.
+ *
+ * The lists of neighbours are hashed in their stored order, since the order affects the resulting layout,
+ * so the same graph built with its edges in a different order gets a different key.
+ * Every field of the attributes is hashed, so the padding of the structure does not matter.
+ */
+inline layout_key hash_layout_input(const graph& g, const attributes& attr) {
+    detail::layout_hasher h;
+    h.add(static_cast<uint32_t>(g.size()));
+    for (auto u : g.vertices()) {
+        h.add(static_cast<uint32_t>(g.out_neighbours(u).size()));
+        for (auto v : g.out_neighbours(u)) {
+            h.add(static_cast<uint32_t>(v));
+        }
+        h.add(static_cast<uint32_t>(g.in_neighbours(u).size()));
+        for (auto v : g.in_neighbours(u)) {
+            h.add(static_cast<uint32_t>(v));
+        }
+    }
+
+    h.add(attr.node_size);
+    h.add(attr.node_dist);
+    h.add(attr.layer_dist);
+    h.add(attr.loop_angle);
+    h.add(attr.loop_size);
+    h.add(static_cast<uint32_t>(attr.positioning));
+    h.add(static_cast<uint32_t>(attr.routing));
+    h.add(static_cast<uint32_t>(attr.routing_threads));
+    h.add(static_cast<uint32_t>(attr.produce_flat_paths));
+    h.add(static_cast<uint32_t>(attr.collect_stats));
+    return h.key();
+}
+
+
+/**
+ * Memoises finished layouts by the key of their input.
+ *
+ * The most recently used layouts are kept in memory up to the given capacity.
+ * If a directory is given, every computed layout is also saved there, so it survives between runs.
+ * The files are in the native representation, so the directory can be shared only between the same builds.
+ *
+ * The cache can be used from several threads at once.
+ * Layouts are computed outside of the lock, so two threads may compute the same layout simultaneously.
+ */
+class layout_cache {
+public:
+    explicit layout_cache(std::size_t capacity = 64, std::string directory = "")
+        : capacity(capacity)
+        , directory(std::move(directory))
+    {
+        if (!this->directory.empty()) {
+            std::filesystem::create_directories(this->directory);
+        }
+    }
+
+    /**
+     * Returns the layout of <g> with attributes <attr>, computing it only if it is not in the cache.
+     */
+    std::shared_ptr<const sugiyama_layout> get(const graph& g, const attributes& attr) {
+        layout_key key = hash_layout_input(g, attr);
+        if (auto l = find(key)) {
+            return l;
+        }
+
+        // the statistics are not saved, so such layouts have to be computed
+        std::shared_ptr<const sugiyama_layout> l;
+        if (!directory.empty() && !attr.collect_stats) {
+            l = load(key, attr);
+        }
+        if (l) {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++disk_hit_count;
+        } else {
+            l = std::make_shared<sugiyama_layout>(g, attr);
+            if (!directory.empty()) {
+                save(key, *l);
+            }
+        }
+
+        insert(key, l);
+        return l;
+    }
+
+    std::size_t hits() const { std::lock_guard<std::mutex> lock(mutex); return hit_count; }
+    std::size_t disk_hits() const { std::lock_guard<std::mutex> lock(mutex); return disk_hit_count; }
+    std::size_t misses() const { std::lock_guard<std::mutex> lock(mutex); return miss_count; }
+
+private:
+    using entry = std::pair< layout_key, std::shared_ptr<const sugiyama_layout> >;
+
+    std::size_t capacity;
+    std::string directory;
+
+    mutable std::mutex mutex;
+    std::list<entry> recent; // the most recently used entry is at the front
+    std::unordered_map< layout_key, std::list<entry>::iterator, detail::layout_key_hash > entries;
+
+    std::size_t hit_count = 0;
+    std::size_t disk_hit_count = 0;
+    std::size_t miss_count = 0;
+
+    struct file_header {
+        char magic[8];
+        uint32_t node_struct_size;
+        uint32_t path_struct_size;
+        uint64_t node_count;
+        uint64_t path_count;
+        uint64_t point_count;
+        uint64_t flat_path_count;
+        uint64_t flat_point_count;
+        vec2 size;
+    };
+
+    static constexpr char magic[8] = { 'D', 'E', 'M', 'E', 'K', 'L', 'Y', '1' };
+
+    std::shared_ptr<const sugiyama_layout> find(const layout_key& key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(key);
+        if (it == entries.end()) {
+            ++miss_count;
+            return nullptr;
+        }
+        ++hit_count;
+        recent.splice(recent.begin(), recent, it->second);
+        return it->second->second;
+    }
+
+    void insert(const layout_key& key, std::shared_ptr<const sugiyama_layout> l) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (capacity == 0 || entries.count(key) > 0) {
+            return;
+        }
+        recent.emplace_front(key, std::move(l));
+        entries[key] = recent.begin();
+        if (recent.size() > capacity) {
+            entries.erase(recent.back().first);
+            recent.pop_back();
+        }
+    }
+
+    std::string file_name(const layout_key& key) const {
+        return directory + "/" + key.str() + ".layout";
+    }
+
+    /**
+     * Saves the layout into a temporary file which is then renamed,
+     * so a concurrent reader never sees a partially written file.
+     */
+    void save(const layout_key& key, const sugiyama_layout& l) const {
+        std::string name = file_name(key);
+        std::string tmp = name + ".tmp" + std::to_string(std::random_device{}());
+        {
+            std::ofstream out(tmp, std::ios::binary);
+            if (!out) {
+                return;
+            }
+
+            file_header header;
+            std::memset(&header, 0, sizeof(header));
+            std::memcpy(header.magic, magic, sizeof(magic));
+            header.node_struct_size = sizeof(node);
+            header.path_struct_size = sizeof(flat_path);
+            header.node_count = l.vertices().size();
+            header.path_count = l.edges().size();
+            for (const auto& p : l.edges()) {
+                header.point_count += p.points.size();
+            }
+            header.flat_path_count = l.flat_edges().paths.size();
+            header.flat_point_count = l.flat_edges().points.size();
+            header.size = l.dimensions();
+
+            write(out, &header, 1);
+            write(out, l.vertices().data(), l.vertices().size());
+            unsigned offset = 0;
+            for (const auto& p : l.edges()) {
+                flat_path f{ p.from, p.to, offset, static_cast<unsigned>(p.points.size()), p.bidirectional, p.spline };
+                write(out, &f, 1);
+                offset += f.count;
+            }
+            for (const auto& p : l.edges()) {
+                write(out, p.points.data(), p.points.size());
+            }
+            write(out, l.flat_edges().paths.data(), l.flat_edges().paths.size());
+            write(out, l.flat_edges().points.data(), l.flat_edges().points.size());
+            if (!out) {
+                out.close();
+                std::filesystem::remove(tmp);
+                return;
+            }
+        }
+
+        std::error_code ec;
+        std::filesystem::rename(tmp, name, ec);
+        if (ec) {
+            std::filesystem::remove(tmp, ec);
+        }
+    }
+
+    /**
+     * Loads the layout from the directory. Returns nullptr if it is missing or unreadable.
+     */
+    std::shared_ptr<const sugiyama_layout> load(const layout_key& key, const attributes& attr) const {
+        std::ifstream in(file_name(key), std::ios::binary);
+        if (!in) {
+            return nullptr;
+        }
+
+        file_header header;
+        if (!read(in, &header, 1) ||
+            std::memcmp(header.magic, magic, sizeof(magic)) != 0 ||
+            header.node_struct_size != sizeof(node) ||
+            header.path_struct_size != sizeof(flat_path))
+        {
+            return nullptr;
+        }
+
+        // the counts come from the file, so they are checked against its size before allocating
+        std::error_code ec;
+        uint64_t remaining = std::filesystem::file_size(file_name(key), ec);
+        if (ec || remaining < sizeof(header)) {
+            return nullptr;
+        }
+        remaining -= sizeof(header);
+        auto fits = [&remaining] (uint64_t count, std::size_t size) {
+            if (count > remaining / size) {
+                return false;
+            }
+            remaining -= count*size;
+            return true;
+        };
+        if (!fits(header.node_count, sizeof(node)) ||
+            !fits(header.path_count, sizeof(flat_path)) ||
+            !fits(header.point_count, sizeof(vec2)) ||
+            !fits(header.flat_path_count, sizeof(flat_path)) ||
+            !fits(header.flat_point_count, sizeof(vec2)))
+        {
+            return nullptr;
+        }
+
+        std::vector<node> nodes(header.node_count);
+        std::vector<flat_path> records(header.path_count);
+        std::vector<vec2> points(header.point_count);
+        flat_paths flat;
+        flat.paths.resize(header.flat_path_count);
+        flat.points.resize(header.flat_point_count);
+        if (!read(in, nodes.data(), nodes.size()) ||
+            !read(in, records.data(), records.size()) ||
+            !read(in, points.data(), points.size()) ||
+            !read(in, flat.paths.data(), flat.paths.size()) ||
+            !read(in, flat.points.data(), flat.points.size()))
+        {
+            return nullptr;
+        }
+
+        // a path has to reference existing points and nodes
+        auto valid = [&nodes] (const flat_path& r, std::size_t point_count) {
+            return uint64_t(r.offset) + r.count <= point_count && r.count >= 2 &&
+                   r.from < nodes.size() && r.to < nodes.size();
+        };
+
+        std::vector<path> paths(records.size());
+        for (std::size_t i = 0; i < records.size(); ++i) {
+            const auto& r = records[i];
+            if (!valid(r, points.size())) {
+                return nullptr;
+            }
+            paths[i].from = r.from;
+            paths[i].to = r.to;
+            paths[i].points.assign(points.begin() + r.offset, points.begin() + r.offset + r.count);
+            paths[i].bidirectional = r.bidirectional;
+            paths[i].spline = r.spline;
+        }
+        for (const auto& r : flat.paths) {
+            if (!valid(r, flat.points.size())) {
+                return nullptr;
+            }
+        }
+
+        return std::shared_ptr<const sugiyama_layout>(
+            new sugiyama_layout(attr, std::move(nodes), std::move(paths), std::move(flat), header.size));
+    }
+
+    template<typename T>
+    static void write(std::ofstream& out, const T* data, std::size_t count) {
+        out.write(reinterpret_cast<const char*>(data), count*sizeof(T));
+    }
+
+    template<typename T>
+    static bool read(std::ifstream& in, T* data, std::size_t count) {
+        return static_cast<bool>( in.read(reinterpret_cast<char*>(data), count*sizeof(T)) );
+    }
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <exception>
+
+namespace detail {
+
+/**
+ * Splits the range [0, n) into at most <threads> contiguous chunks of similar size
+ * and calls f(chunk_idx, begin, end) for each of them on a separate thread.
+ * The first chunk is processed by the calling thread.
+ * Returns after all the chunks are processed.
+ * If any of the calls throws, the exception of the chunk with the lowest index is rethrown
+ * on the calling thread once all the chunks have finished.
+ */
+template<typename F>
+void parallel_chunks(std::size_t n, unsigned threads, F f) {
+    threads = std::max(1u, static_cast<unsigned>( std::min<std::size_t>(threads, n) ));
+    if (threads == 1) {
+        f(0u, std::size_t(0), n);
+        return;
+    }
+
+    std::vector<std::exception_ptr> errors(threads);
+    auto run = [&f, &errors] (unsigned i, std::size_t begin, std::size_t end) {
+        try {
+            f(i, begin, end);
+        } catch (...) {
+            errors[i] = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for (unsigned i = 1; i < threads; ++i) {
+        workers.emplace_back(run, i, (n*i)/threads, (n*(i + 1))/threads);
+    }
+    run(0u, std::size_t(0), n/threads);
+
+    for (auto& w : workers) {
+        w.join();
+    }
+    for (const auto& e : errors) {
+        if (e) {
+            std::rethrow_exception(e);
+        }
+    }
+}
+
+/**
+ * Calls f(i) for all i in [0, n) using at most <threads> threads.
+ */
+template<typename F>
+void parallel_for(std::size_t n, unsigned threads, F f) {
+    parallel_chunks(n, threads, [&f] (unsigned, std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+            f(i);
+        }
+    });
+}
+
+} // namespace detail
@@ -9,6 +9,7 @@
 #include "subgraph.hpp"
 #include "vec2.hpp"
 #include "layering.hpp"
+#include "cancellation.hpp"
 
 #ifdef DEBUG_COORDINATE
 int produce_layout = 0;
@@ -32,6 +33,8 @@ struct bounding_box {
 struct positioning {
     virtual vec2 run(detail::hierarchy& h, vec2 origin) = 0;
     virtual ~positioning() = default;
+
+    const cancellation_token* cancel = nullptr; /**< checked regularly if set */
 };
 
 
@@ -68,11 +71,16 @@ struct test_positioning : public positioning {
 
 
 class fast_and_simple_positioning : public positioning {
+protected:
+    enum orient { upper_left, lower_left, upper_right, lower_right };
+
+private:
     std::vector<node>& nodes;
     attributes attr;
     const detail::vertex_map<bounding_box>& boxes;
 
-    enum orient { upper_left, lower_left, upper_right, lower_right };
+    // the alignments which are computed, the final position is the median of their results
+    std::vector<orient> layouts = { upper_left, lower_left, upper_right, lower_right };
 
     std::array< detail::vertex_map<vertex_t>, 4 > medians;
     std::array< detail::vertex_map<vertex_t>, 4 > root;
@@ -96,8 +104,11 @@ public:
     { }
 
     void init(const detail::hierarchy& h) {
-        for (int i = 0; i < 4; ++i) {
+        // only the arrays of the computed alignments are allocated,
+        // an alignment uses the medians of its own and of the horizontally inverted direction
+        for (auto i : layouts) {
             medians[i].resize(h.g);
+            medians[invert_horizontal(i)].resize(h.g);
             root[i].resize(h.g);
             align[i].resize(h.g);
             sink[i].resize(h.g);
@@ -109,7 +120,7 @@ public:
         }
 
         for (auto u : h.g.vertices()) {
-            for (int j = 0; j < 4; ++j) {
+            for (auto j : layouts) {
                 root[j][u] = u;
                 align[j][u] = u;
                 sink[j][u] = u;
@@ -124,9 +135,10 @@ public:
 
         mark_conflicts(h);
 
-        for (int i = 0; i < 4; ++i) {
-            vertical_align(h, static_cast<orient>(i));
-            horizontal_compaction(h, static_cast<orient>(i));
+        for (auto i : layouts) {
+            check_cancelled(cancel);
+            vertical_align(h, i);
+            horizontal_compaction(h, i);
         }
 
 #ifdef DEBUG_COORDINATE
@@ -164,9 +176,13 @@ public:
                     nodes[u].pos = vec2{ *x[produce_layout][u] + shift[produce_layout], y };
                 } else {
 #endif
-                vals = { *x[0][u], *x[1][u], *x[2][u], *x[3][u] };
-                std::sort(vals.begin(), vals.end());
-                nodes[u].pos = { (vals[1] + vals[2])/2, y };
+                if (layouts.size() == 1) {
+                    nodes[u].pos = { *x[ layouts[0] ][u], y };
+                } else {
+                    vals = { *x[0][u], *x[1][u], *x[2][u], *x[3][u] };
+                    std::sort(vals.begin(), vals.end());
+                    nodes[u].pos = { (vals[1] + vals[2])/2, y };
+                }
 #ifdef DEBUG_COORDINATE
                 }
 #endif
@@ -180,15 +196,15 @@ public:
     }
 
     void align_layouts(const hierarchy& h) {
-        orient min_width_layout = static_cast<orient>(0);
-        for (int i = 1; i < 4; ++i) {
+        orient min_width_layout = layouts[0];
+        for (auto i : layouts) {
             if ( max[min_width_layout] - min[min_width_layout] > max[i] - min[i] ) {
-                min_width_layout = static_cast<orient>(i);
+                min_width_layout = i;
             }
         }
 
-        for (int i = 0; i < 4; ++i) {
-            float d = left(static_cast<orient>(i)) ?
+        for (auto i : layouts) {
+            float d = left(i) ?
                            min[min_width_layout] - min[i] :
                            max[min_width_layout] - max[i];
 
@@ -219,10 +235,26 @@ public:
     }
 
 
+protected:
+    fast_and_simple_positioning(attributes attr, 
+                                std::vector<node>& nodes,
+                                const detail::vertex_map<bounding_box>& boxes,
+                                std::vector<orient> layouts)
+        : nodes(nodes)
+        , attr(attr)
+        , boxes(boxes)
+        , layouts(std::move(layouts))
+    { }
+
+public:
+    // computes the medians only for the vertical directions of the computed alignments
     void init_medians(const detail::hierarchy& h) {
-        std::vector<vertex_t> neighbours;
+        bool lower = std::any_of(layouts.begin(), layouts.end(), [this] (orient dir) { return !up(dir); });
+        bool upper = std::any_of(layouts.begin(), layouts.end(), [this] (orient dir) { return up(dir); });
+
+        std::pmr::vector<vertex_t> neighbours(h.g.resource());
         for (auto u : h.g.vertices()) {
-            {
+            if (lower) {
                 neighbours.insert(neighbours.begin(), h.g.out_neighbours(u).begin(), h.g.out_neighbours(u).end());
                 auto [ left, right ] = median(h, u, neighbours);
                 medians[orient::lower_left][u] = left;
@@ -230,16 +262,18 @@ public:
                 neighbours.clear();
             }
 
-            neighbours.insert(neighbours.begin(), h.g.in_neighbours(u).begin(), h.g.in_neighbours(u).end());
-            auto [ left, right ] = median(h, u, neighbours);
-            medians[orient::upper_left][u] = left;
-            medians[orient::upper_right][u] = right;
-            neighbours.clear();
+            if (upper) {
+                neighbours.insert(neighbours.begin(), h.g.in_neighbours(u).begin(), h.g.in_neighbours(u).end());
+                auto [ left, right ] = median(h, u, neighbours);
+                medians[orient::upper_left][u] = left;
+                medians[orient::upper_right][u] = right;
+                neighbours.clear();
+            }
         }
     }
 
     template< typename Neighbours >
-    std::pair<vertex_t, vertex_t> median(const hierarchy& h, vertex_t u, Neighbours neigh) {
+    std::pair<vertex_t, vertex_t> median(const hierarchy& h, vertex_t u, Neighbours& neigh) {
         int count = neigh.size();
         int m = count / 2;
         if (count == 0) {
@@ -298,11 +332,11 @@ public:
             int last_pos = 0;
             int p = 0;
 
-            for ( int j = 0; j < h.layers[i].size(); ++j ) {
+            for ( int j = 0; j < static_cast<int>(h.layers[i].size()); ++j ) {
                 auto& lay = h.layers[i];
                 vertex_t u = lay[j];
 
-                if ( j == h.layers[i].size() - 1 || is_inner(h, u) ) {
+                if ( j == static_cast<int>(h.layers[i].size()) - 1 || is_inner(h, u) ) {
                     int curr_pos = h.layers[i + 1].size();
 
                     if (is_inner(h, u)) {
@@ -330,7 +364,7 @@ public:
         detail::vertex_map<vertex_t>& root = this->root[dir];
 
         for ( auto l : idx_range(h.size(), !up(dir)) ) {
-            auto layer = h.layers[l];
+            const auto& layer = h.layers[l];
 
             int m_pos = left(dir) ? 0 : h.g.size();
             int d = left(dir) ? 1 : -1;
@@ -360,12 +394,13 @@ public:
 
         for (auto u : h.g.vertices()) {
             if (root[u] == u) {
+                check_cancelled(cancel);
                 place_block(h, u, dir);
             }
         }
 
         for (auto i : idx_range(h.size(), up(dir))) {
-            auto layer = h.layers[i];
+            const auto& layer = h.layers[i];
             for (auto u : layer) {
                 x[u] = *x[ root[u] ] + shift[ sink[ root[u] ] ];   
 
@@ -444,7 +479,7 @@ public:
 
     // Is i one of the endpoints of the interval <0, size - 1>
     bool is_last_idx(int i, std::size_t size, bool desc) const {
-        return (desc && i == size - 1) || (!desc && i == 0);
+        return (desc && i == static_cast<int>(size) - 1) || (!desc && i == 0);
     }
 
     orient invert_horizontal(orient dir) {
@@ -459,8 +494,25 @@ public:
                 return orient::lower_left;      
         }
         assert(false);
+        return dir;
     }
 
 };
 
+
+/**
+ * Brandes-Köpf positioning which computes only the upper left alignment
+ * instead of taking the median of all four.
+ * It needs about a quarter of the time and memory of fast_and_simple_positioning,
+ * but the resulting layout is less balanced and leans to the left.
+ */
+class single_alignment_positioning : public fast_and_simple_positioning {
+public:
+    single_alignment_positioning(attributes attr, 
+                                 std::vector<node>& nodes,
+                                 const detail::vertex_map<bounding_box>& boxes)
+        : fast_and_simple_positioning(attr, nodes, boxes, { orient::upper_left })
+    { }
+};
+
 } // namespace detail
\ No newline at end of file
@@ -1,25 +1,65 @@
 #pragma once
 
-#ifdef REPORTING
-
-namespace report {
-
-    // network simplex
-    namespace simplex {
-        inline int iters = 0;
-    } 
-
-    //namespace crossing {
-        // crossing stuff
-        inline int random_runs = -1;
-        inline int forgivness = -1;
-        inline bool transpose = false; 
-
-        inline int base = 0;
-        inline int final = 0;
-        inline int iters = 0;
-        inline std::vector<int> random_final;
-    //}
+#include <array>
+#include <vector>
+
+/**
+ * The individual steps of the layout in the order in which they run.
+ * All the steps except split run once for each connected component.
+ */
+enum class layout_stage { split, cycle_removal, layering, dummy_nodes, crossing_reduction, positioning, routing };
+
+constexpr int layout_stage_count = 7;
+
+inline const char* stage_name(layout_stage s) {
+    static const char* names[] = { "split", "cycle_removal", "layering", "dummy_nodes",
+                                   "crossing_reduction", "positioning", "routing" };
+    return names[static_cast<int>(s)];
 }
 
-#endif
+
+/**
+ * Statistics about laying out one connected component.
+ *
+ * Each component has its own record which is written only by the modules processing that component,
+ * so the components can be laid out concurrently.
+ */
+struct component_stats {
+    unsigned vertices = 0;           /**< number of vertices of the component */
+    unsigned dummy_nodes = 0;        /**< number of dummy vertices added to split the long edges */
+
+    int simplex_iters = 0;           /**< number of tree edge exchanges in network simplex */
+
+    int initial_crossings = 0;       /**< crossings after the initial ordering of layers */
+    std::vector<int> run_crossings;  /**< the fewest crossings found in each randomized run */
+    int final_crossings = 0;         /**< crossings after the crossing reduction */
+    int crossing_iters = 0;          /**< number of barycenter sweeps over all the runs */
+    int transpose_passes = 0;        /**< number of passes of the transpose heuristic */
+
+    std::array<double, layout_stage_count> stage_micros{}; /**< time spent in each stage, in microseconds */
+};
+
+
+/**
+ * Statistics about one layout, collected if attributes::collect_stats is set.
+ */
+struct layout_stats {
+    std::array<double, layout_stage_count> stage_micros{}; /**< total time spent in each stage, in microseconds */
+    std::vector<component_stats> components;
+
+    int simplex_iters() const { return sum(&component_stats::simplex_iters); }
+    int initial_crossings() const { return sum(&component_stats::initial_crossings); }
+    int final_crossings() const { return sum(&component_stats::final_crossings); }
+    int transpose_passes() const { return sum(&component_stats::transpose_passes); }
+    unsigned dummy_nodes() const { return sum(&component_stats::dummy_nodes); }
+
+private:
+    template<typename T>
+    T sum(T component_stats::* field) const {
+        T total = 0;
+        for (const auto& c : components) {
+            total += c.*field;
+        }
+        return total;
+    }
+};
@@ -2,6 +2,7 @@
 
 #include "types.hpp"
 #include "subgraph.hpp"
+#include "parallel.hpp"
 
 #include <vector>
 #include <cmath>
@@ -17,22 +18,44 @@ struct edge_router {
 };
 
 class router : public edge_router {
+protected:
     const float min_sep = 5;
     const float loop_angle_sep = 5;
+    const float shift_tolerance = 0.01;
+    const int max_shift_rounds = 4;
     
     const attributes& attr;
     std::vector<node>& nodes;
     std::vector<path>& links;
+    flat_paths& flat_links;
+
+    /**
+     * Paths created by one thread. 
+     * The offsets of the paths are relative to the start of the local buffer of points.
+     */
+    struct route_buffer {
+        flat_paths out;
+
+        // scratch space for routers which need to remember more than the control points
+        std::vector<vec2> knots;
+        std::vector<float> tangents;
+    };
+
+    std::vector< route_buffer > buffers;
+
+    // the first edges of all paths in the order in which the paths are saved
+    std::vector< edge > starts;
 
     vertex_map< std::array< float, 4> > shifts;
 
     vertex_map< bool > has_loop;
 
 public:
-    router(std::vector<node>& nodes, std::vector<path>& paths, const attributes& attr) 
+    router(std::vector<node>& nodes, std::vector<path>& paths, flat_paths& flat, const attributes& attr) 
         : attr(attr)
         , nodes(nodes)
-        , links(paths) {}
+        , links(paths)
+        , flat_links(flat) {}
 
     void run(const hierarchy& h, const feedback_set& rev) override {
         init(h, rev);
@@ -40,7 +63,7 @@ public:
         make_paths(h, rev);
     }
 
-private:
+protected:
     void init(const hierarchy& h, const feedback_set& rev) {
         shifts.init( h.g, { 0 } );
         
@@ -50,28 +73,98 @@ private:
         }
     }
 
+    /**
+     * The shifts of edges between layers i and i + 1 depend only on the vertices on these two layers.
+     * When routing in parallel, every other band of edges is processed at once,
+     * so the result does not depend on the number of threads.
+     */
     void calculate_shifts(const hierarchy& h) {
-        for (const auto l : h.layers) {
-            for (auto u : l) {
-                for (auto v : h.g.out_neighbours(u)) {
-                    if (!h.g.is_dummy(u) || !h.g.is_dummy(v)) 
-                        set_regular_shifts(h, {u, v});
-                }
+        if (attr.routing_threads <= 1) {
+            for (int i = 0; i < h.size(); ++i) {
+                set_band_shifts(h, i);
+            }
+        } else {
+            for (int phase = 0; phase < 2; ++phase) {
+                parallel_for((h.size() - phase + 1)/2, attr.routing_threads, [&] (std::size_t i) {
+                    set_band_shifts(h, phase + 2*i);
+                });
             }
         }
         unify_dummy_shifts(h);
     }
 
+    // sets the shifts of all edges going from the given layer
+    void set_band_shifts(const hierarchy& h, int layer) {
+        for (auto u : h.layers[layer]) {
+            for (auto v : h.g.out_neighbours(u)) {
+                if (!h.g.is_dummy(u) || !h.g.is_dummy(v)) 
+                    set_regular_shifts(h, {u, v});
+            }
+        }
+    }
+
     void make_paths(const hierarchy& h, const feedback_set& rev) {
+        starts.clear();
         for (auto u : h.g.vertices()) {
             for (auto v : h.g.out_neighbours(u)) {
-                if (!h.g.is_dummy(u)) make_path(h, rev, u, v);
+                if (!h.g.is_dummy(u)) starts.push_back( {u, v} );
             }
         }
 
+        unsigned threads = std::max(1u, attr.routing_threads);
+        buffers.resize(threads);
+        for (auto& buf : buffers) {
+            buf.out.paths.clear();
+            buf.out.points.clear();
+        }
+
+        parallel_chunks(starts.size(), threads, [&] (unsigned t, std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; ++i) {
+                make_path(h, rev, starts[i].from, starts[i].to, buffers[t]);
+            }
+        });
+
         for (auto u : rev.loops) {
-            make_loop_square(u);
+            make_loop_square(u, buffers.back());
+        }
+
+        save_paths();
+    }
+
+    // moves the paths from the buffers into the final output, preserving their order
+    void save_paths() {
+        std::vector<std::size_t> path_offsets(buffers.size() + 1, 0);
+        std::vector<std::size_t> point_offsets(buffers.size() + 1, 0);
+        path_offsets[0] = attr.produce_flat_paths ? flat_links.paths.size() : links.size();
+        point_offsets[0] = flat_links.points.size();
+        for (std::size_t i = 0; i < buffers.size(); ++i) {
+            path_offsets[i + 1] = path_offsets[i] + buffers[i].out.paths.size();
+            point_offsets[i + 1] = point_offsets[i] + buffers[i].out.points.size();
         }
+
+        if (attr.produce_flat_paths) {
+            flat_links.paths.resize(path_offsets.back());
+            flat_links.points.resize(point_offsets.back());
+        } else {
+            links.resize(path_offsets.back());
+        }
+
+        parallel_for(buffers.size(), attr.routing_threads, [&] (std::size_t i) {
+            const auto& buf = buffers[i].out;
+            for (std::size_t j = 0; j < buf.paths.size(); ++j) {
+                auto l = buf.paths[j];
+                if (attr.produce_flat_paths) {
+                    l.offset += point_offsets[i];
+                    flat_links.paths[ path_offsets[i] + j ] = l;
+                } else {
+                    auto points = buf.points_of(l);
+                    links[ path_offsets[i] + j ] = path{ l.from, l.to, { points.begin(), points.end() }, l.bidirectional, l.spline };
+                }
+            }
+            if (attr.produce_flat_paths) {
+                std::copy(buf.points.begin(), buf.points.end(), flat_links.points.begin() + point_offsets[i]);
+            }
+        });
     }
 
     void set_regular_shifts(const hierarchy& h, edge e) {
@@ -128,22 +221,22 @@ private:
             float s = get_shift(e.from, dirs);
             float t = get_shift(e.to, -dirs);
 
-            bool up_done = false, down_done = false;
-            while (!up_done || !down_done) {
+            // raising one end can bring the edge closer to the other vertex so alternate until both are clear
+            for (int i = 0; i < max_shift_rounds; ++i) {
+                float old_s = s, old_t = t;
+
                 if (can_inter_up && s <= node_size && line_point_dist(from, to, c_up) <= r_up + min_sep) {
-                    s += 5;
+                    s = clearing_shift(pos(e.from), { 0, dirs.y }, to, c_up, r_up + min_sep, s);
                     from = pos(e.from) + vec2{ 0, dirs.y*s };
-                    up_done = false;
-                } else {
-                    up_done = true;
                 }
 
                 if (can_inter_down && t <= node_size && line_point_dist(to, from, c_down) <= r_down + min_sep) {
-                    t += 5;
+                    t = clearing_shift(pos(e.to), { 0, -dirs.y }, from, c_down, r_down + min_sep, t);
                     to = pos(e.to) + vec2{ 0, -dirs.y*t };
-                    down_done = false;
-                } else {
-                    down_done = true;
+                }
+
+                if (s == old_s && t == old_t) {
+                    break;
                 }
             }
 
@@ -156,22 +249,51 @@ private:
         }
     }
 
+    /**
+     * Calculates the smallest shift of the port of a vertex at <center> 
+     * such that the edge going to <other> is further than <dist> from <obstacle>.
+     * If no shift smaller than the node size is sufficient, the node size is returned.
+     */
+    float clearing_shift(vec2 center, vec2 dir, vec2 other, vec2 obstacle, float dist, float shift) {
+        auto s = line_point_clearance(center, dir, other, obstacle, dist + shift_tolerance, shift);
+        if (!s || *s > attr.node_size) {
+            return attr.node_size;
+        }
+        return *s;
+    }
+
     float get_shift(edge e) { return get_shift(e.from, get_dirs(e)); }
     float get_shift(vertex_t u, vec2 dirs) { return get_shift(u, dir_idx(dirs)); }
     float get_shift(vertex_t u, int quadrant) { return shifts[u][quadrant]; }
 
+    /**
+     * Unifying the shifts on a layer can change the shifts on the two adjacent layers,
+     * so when routing in parallel, every third layer is processed at once.
+     */
     void unify_dummy_shifts(const hierarchy& h) {
-        for (int layer_idx = 0; layer_idx < h.size(); ++layer_idx) {
-            const auto& l = h.layers[layer_idx];
-            int j = -1;
-            for (int i = 0; i < l.size(); ++i) {
-                if ( !h.g.is_dummy(l[i]) ) {
-                    set_sequence_shifts(h, layer_idx, j + 1, i - 1);
-                    j = i; 
-                }
+        if (attr.routing_threads <= 1) {
+            for (int i = 0; i < h.size(); ++i) {
+                unify_layer_shifts(h, i);
+            }
+        } else {
+            for (int phase = 0; phase < 3; ++phase) {
+                parallel_for((h.size() - phase + 2)/3, attr.routing_threads, [&] (std::size_t i) {
+                    unify_layer_shifts(h, phase + 3*i);
+                });
+            }
+        }
+    }
+
+    void unify_layer_shifts(const hierarchy& h, int layer_idx) {
+        const auto& l = h.layers[layer_idx];
+        int j = -1;
+        for (int i = 0; i < static_cast<int>(l.size()); ++i) {
+            if ( !h.g.is_dummy(l[i]) ) {
+                set_sequence_shifts(h, layer_idx, j + 1, i - 1);
+                j = i; 
             }
-            set_sequence_shifts(h, layer_idx, j + 1, l.size() - 1);
         }
+        set_sequence_shifts(h, layer_idx, j + 1, l.size() - 1);
     }
 
     void set_sequence_shifts(const hierarchy& h, int layer, int start, int end) {
@@ -306,60 +428,58 @@ private:
     vertex_t prev(const subgraph& g, vertex_t u) { return *g.in_neighbours(u).begin(); }
 
 
-    void make_path(const hierarchy& h, const feedback_set& rev, vertex_t u, vertex_t v) {
+    virtual void make_path(const hierarchy& h, const feedback_set& rev, vertex_t u, vertex_t v, route_buffer& buf) {
         auto& g = h.g;
-        path l{ u, v, {} };
         auto orig = edge{ u, v };
+        auto& points = buf.out.points;
+        auto start = points.size();
 
-        l.points.push_back( calculate_port_shifted(u, nodes[v].pos - nodes[u].pos) );
+        points.push_back( calculate_port_shifted(u, nodes[v].pos - nodes[u].pos) );
 
         while (g.is_dummy(v)) {
             auto s = shifts[v][dir_idx(get_dirs(edge{v, u}))];
             if (s > 0)
-                l.points.push_back( nodes[v].pos + vec2{ 0, -s } );
+                points.push_back( nodes[v].pos + vec2{ 0, -s } );
             
-            l.points.push_back( nodes[v].pos );
+            points.push_back( nodes[v].pos );
 
             auto n = next(g, v);
             s = shifts[v][dir_idx(get_dirs(edge{v, n}))];
             if (s > 0)
-                l.points.push_back( nodes[v].pos + vec2{ 0, s } );
+                points.push_back( nodes[v].pos + vec2{ 0, s } );
 
             u = v;
             v = n;
         }
 
-        l.points.push_back( calculate_port_shifted(v, nodes[u].pos - nodes[v].pos) );
-        l.to = v;
+        points.push_back( calculate_port_shifted(v, nodes[u].pos - nodes[v].pos) );
 
         if (rev.reversed.contains(orig)) {
-            reverse(l);
-        } else if (rev.removed.contains(orig)) {
-            l.bidirectional = true;
+            std::reverse(points.begin() + start, points.end());
+            add_path(buf, start, v, orig.from, false);
+        } else {
+            add_path(buf, start, orig.from, v, rev.removed.contains(orig));
         }
-
-        links.push_back(std::move(l));
     }
 
-    void reverse(path& l) {
-        std::swap(l.from, l.to);
-        for (int i = 0; i < l.points.size()/2; ++i) {
-            std::swap(l.points[i], l.points[l.points.size() - i - 1]);
-        }
-    }
-    
+    void make_loop_square(vertex_t u, route_buffer& buf) {
+        auto& points = buf.out.points;
+        auto start = points.size();
+        points.resize(start + 4);
 
-    void make_loop_square(vertex_t u) {
-        path l{ u, u, {} };
-        l.points.resize(4);
+        points[start] = angle_point(attr.loop_angle, u, { 1, -1 });
+        points[start + 3] = angle_point(attr.loop_angle, u, { 1, 1 });
 
-        l.points[0] = angle_point(attr.loop_angle, u, { 1, -1 });
-        l.points[3] = angle_point(attr.loop_angle, u, { 1, 1 });
+        points[start + 1] = vec2{ pos(u).x + attr.node_size + attr.loop_size/2, points[start].y };
+        points[start + 2] = vec2{ pos(u).x + attr.node_size + attr.loop_size/2, points[start + 3].y };
 
-        l.points[1] = vec2{ pos(u).x + attr.node_size + attr.loop_size/2, l.points[0].y };
-        l.points[2] = vec2{ pos(u).x + attr.node_size + attr.loop_size/2, l.points[3].y };
+        add_path(buf, start, u, u, false);
+    }
 
-        links.push_back(std::move(l));
+    // saves the path whose control points start at index <start> of the buffer
+    void add_path(route_buffer& buf, std::size_t start, vertex_t from, vertex_t to, bool bidirectional, bool spline = false) {
+        auto count = buf.out.points.size() - start;
+        buf.out.paths.push_back( flat_path{ from, to, static_cast<unsigned>(start), static_cast<unsigned>(count), bidirectional, spline } );
     }
 
     // calculate the port using shifts
@@ -385,4 +505,96 @@ private:
 
 };
 
+
+/**
+ * Router which replaces the poly-lines of edges going through dummy vertices with smooth curves.
+ * 
+ * The curve passes through the ports and the dummy vertices where it is vertical.
+ * The length of the tangent at a dummy vertex is given by its shifts,
+ * so the curve stays within the area bounded by the poly-line the regular router would produce.
+ * Edges without dummy vertices and loops are kept as poly-lines.
+ * 
+ * The control points of a curve are saved as p0, c0, d1, p1, d2, p2, ..., dn, pn.
+ * The first segment is a cubic Bézier curve (p0, c0, d1, p1). Every other segment (p[i-1], c, d[i], p[i])
+ * has its first control point c = 2*p[i-1] - d[i-1] - the reflection of the previous control point.
+ * This is exactly the format of the 'C' and 'S' commands of an SVG path.
+ */
+class spline_router : public router {
+public:
+    spline_router(std::vector<node>& nodes, std::vector<path>& paths, flat_paths& flat, const attributes& attr) 
+        : router(nodes, paths, flat, attr) {}
+
+protected:
+    void make_path(const hierarchy& h, const feedback_set& rev, vertex_t u, vertex_t v, route_buffer& buf) override {
+        auto& g = h.g;
+        if (!g.is_dummy(v)) {
+            router::make_path(h, rev, u, v, buf);
+            return;
+        }
+
+        auto orig = edge{ u, v };
+        auto& knots = buf.knots;
+        auto& tangents = buf.tangents;
+        knots.clear();
+        tangents.clear();
+
+        knots.push_back( calculate_port_shifted(u, nodes[v].pos - nodes[u].pos) );
+        tangents.push_back(0);
+
+        while (g.is_dummy(v)) {
+            auto n = next(g, v);
+            knots.push_back( nodes[v].pos );
+            tangents.push_back( std::max( shifts[v][dir_idx(get_dirs(edge{v, u}))], 
+                                          shifts[v][dir_idx(get_dirs(edge{v, n}))] ) );
+            u = v;
+            v = n;
+        }
+
+        knots.push_back( calculate_port_shifted(v, nodes[u].pos - nodes[v].pos) );
+        tangents.push_back(0);
+
+        bool reversed = rev.reversed.contains(orig);
+        if (reversed) {
+            std::reverse(knots.begin(), knots.end());
+            std::reverse(tangents.begin(), tangents.end());
+        }
+
+        auto start = buf.out.points.size();
+        make_curve(buf);
+
+        if (reversed) {
+            add_path(buf, start, v, orig.from, false, true);
+        } else {
+            add_path(buf, start, orig.from, v, rev.removed.contains(orig), true);
+        }
+    }
+
+private:
+    // converts the knots into the control points of the curve
+    void make_curve(route_buffer& buf) const {
+        const auto& knots = buf.knots;
+        auto& points = buf.out.points;
+        int n = knots.size() - 1;
+
+        points.push_back(knots[0]);
+        points.push_back(knots[0] + (incoming(buf, 1) - knots[0])/3);
+        for (int i = 1; i < n; ++i) {
+            points.push_back(incoming(buf, i));
+            points.push_back(knots[i]);
+        }
+        vec2 out = 2*knots[n - 1] - incoming(buf, n - 1);
+        points.push_back(knots[n] + (out - knots[n])/3);
+        points.push_back(knots[n]);
+    }
+
+    // the control point preceding the i-th knot, which has to be a dummy vertex
+    vec2 incoming(const route_buffer& buf, int i) const {
+        const auto& knots = buf.knots;
+        float dy = std::min( std::fabs(knots[i].y - knots[i - 1].y), std::fabs(knots[i + 1].y - knots[i].y) );
+        float t = buf.tangents[i] > 0 ? buf.tangents[i] : dy/4;
+        t = std::min(t, dy/2);
+        return knots[i] - vec2{ 0, sgn(knots[i + 1].y - knots[i - 1].y) * t };
+    }
+};
+
 } // namespace detail
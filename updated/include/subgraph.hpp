@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vector>
+#include <memory_resource>
 #include <algorithm>
 #include <map>
 
@@ -34,16 +35,18 @@ inline std::ostream& operator<<(std::ostream& out, edge e) {
  * 
  * Vertices which are added after the construction are called dummy vertices. 
  * They can be used to distinguis between the vertices of the original graph and vertices which were added for "algorithmic" purpouses.
+ * 
+ * The subgraph and all the structures created for it (vertex maps, hierarchies) allocate from the memory resource of the graph.
  */
 class subgraph {
     graph& m_source;
-    std::vector< vertex_t > m_vertices;
+    std::pmr::vector< vertex_t > m_vertices;
     vertex_t m_dummy_border;
     
 public:
-    subgraph(graph& g, std::vector< vertex_t > vertices) 
+    subgraph(graph& g, std::pmr::vector< vertex_t > vertices) 
         : m_source(g)
-        , m_vertices(std::move(vertices)) {
+        , m_vertices(std::move(vertices), g.resource()) {
             if (!m_vertices.empty()) {
                 m_dummy_border = 1 + *std::max_element(m_vertices.begin(), m_vertices.end());
             } else {
@@ -73,9 +76,9 @@ public:
     }
     bool has_edge(vertex_t u, vertex_t v) const { return has_edge( { u, v } ); }
 
-    const std::vector<vertex_t>& out_neighbours(vertex_t u) const { return m_source.out_neighbours(u); }
-    const std::vector<vertex_t>& in_neighbours(vertex_t u) const { return m_source.in_neighbours(u); }
-    chain_range< std::vector<vertex_t> > neighbours(vertex_t u) const { return { out_neighbours(u), in_neighbours(u) }; }
+    const std::pmr::vector<vertex_t>& out_neighbours(vertex_t u) const { return m_source.out_neighbours(u); }
+    const std::pmr::vector<vertex_t>& in_neighbours(vertex_t u) const { return m_source.in_neighbours(u); }
+    chain_range< std::pmr::vector<vertex_t> > neighbours(vertex_t u) const { return { out_neighbours(u), in_neighbours(u) }; }
 
     vertex_t out_neighbour(vertex_t u, int i) const { return m_source.out_neighbours(u)[i]; }
     vertex_t in_neighbour(vertex_t u, int i) const { return m_source.in_neighbours(u)[i]; }
@@ -83,8 +86,10 @@ public:
     unsigned out_degree(vertex_t u) const { return m_source.out_neighbours(u).size(); }
     unsigned in_deree(vertex_t u) const { return m_source.in_neighbours(u).size(); }
 
-    const std::vector<vertex_t>& vertices() const { return m_vertices; }
+    const std::pmr::vector<vertex_t>& vertices() const { return m_vertices; }
     vertex_t vertex(int i) const { return m_vertices[i]; }
+
+    std::pmr::memory_resource* resource() const { return m_source.resource(); }
 };
 
 
@@ -109,7 +114,7 @@ inline std::ostream& operator<<(std::ostream& out, const subgraph& g) {
 /**
  * Recursively assign u and all vertices reachable from u in the underlying undirected graph to the same component.
  */
-inline void split(const graph& g, std::vector<bool>& done, std::vector<vertex_t>& component, vertex_t u) {
+inline void split(const graph& g, std::pmr::vector<bool>& done, std::pmr::vector<vertex_t>& component, vertex_t u) {
     done[u] = true;
     component.push_back(u);
     for (auto v : g.out_neighbours(u)) {
@@ -129,8 +134,8 @@ inline void split(const graph& g, std::vector<bool>& done, std::vector<vertex_t>
  * Split the given graph into connected components represented by subgrapgs.
  */
 inline std::vector<subgraph> split(graph& g) {
-    std::vector< std::vector<vertex_t> > components;
-    std::vector< bool > done(g.size(), false);
+    std::pmr::vector< std::pmr::vector<vertex_t> > components(g.resource());
+    std::pmr::vector< bool > done(g.size(), false, g.resource());
 
     for (auto u : g.vertices()) {
         if (!done[u]) {
@@ -140,8 +145,8 @@ inline std::vector<subgraph> split(graph& g) {
     }
 
     std::vector<subgraph> subgraphs;
-    for (auto component : components) {
-        subgraphs.emplace_back(g, component);
+    for (auto& component : components) {
+        subgraphs.emplace_back(g, std::move(component));
     }
 
     return subgraphs;
@@ -154,18 +159,22 @@ inline std::vector<subgraph> split(graph& g) {
 
 /**
  * Maps vertices to objects of type T
+ * 
+ * A map created for a graph or a subgraph allocates from the memory resource of the graph, 
+ * a default constructed one from the default resource.
  */
 template< typename T >
 struct vertex_map {
-    std::vector< T > data;
+    std::pmr::vector< T > data;
 
     vertex_map() = default;
+    explicit vertex_map(std::pmr::memory_resource* resource) : data(resource) {}
 
-    vertex_map(const graph& g) : data(g.size(), T{}) {}
-    vertex_map(const graph& g, T val) : data(g.size(), val) {}
+    vertex_map(const graph& g) : data(g.size(), T{}, g.resource()) {}
+    vertex_map(const graph& g, T val) : data(g.size(), val, g.resource()) {}
 
     vertex_map(const subgraph& g) : vertex_map(g, T{}) {}
-    vertex_map(const subgraph& g, T val) {
+    vertex_map(const subgraph& g, T val) : data(g.resource()) {
         for (auto u : g.vertices()) {
             if (u >= data.size()) {
                 data.resize(u + 1);
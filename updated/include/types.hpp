@@ -1,5 +1,6 @@
 #pragma once
 
+#include <limits>
 #include <string>
 #include <vector>
 
@@ -24,6 +25,73 @@ struct path {
     vertex_t from, to;          /**< the vertex identifiers of endpoints of the corresponding edge */
     std::vector< vec2 > points; /**< control points of the poly-line representing the edge */
     bool bidirectional = false; /**< is the edge bidirectional? */
+    bool spline = false;        /**< are the points control points of a curve? (see detail::spline_router) */
+};
+
+/**
+ * Non-owning view of a contiguous sequence of control points.
+ */
+struct point_span {
+    const vec2* first = nullptr;
+    std::size_t count = 0;
+
+    point_span() = default;
+    point_span(const vec2* first, std::size_t count) : first(first), count(count) {}
+    point_span(const std::vector< vec2 >& points) : first(points.data()), count(points.size()) {}
+
+    const vec2* begin() const { return first; }
+    const vec2* end() const { return first + count; }
+    const vec2* data() const { return first; }
+
+    std::size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    const vec2& operator[](std::size_t i) const { return first[i]; }
+    const vec2& front() const { return first[0]; }
+    const vec2& back() const { return first[count - 1]; }
+};
+
+/**
+ * Object representing an edge in the final layout whose control points are stored in a shared buffer.
+ */
+struct flat_path {
+    vertex_t from, to;          /**< the vertex identifiers of endpoints of the corresponding edge */
+    unsigned offset;            /**< index of the first control point in the shared buffer */
+    unsigned count;             /**< number of control points */
+    bool bidirectional = false; /**< is the edge bidirectional? */
+    bool spline = false;        /**< are the points control points of a curve? (see detail::spline_router) */
+};
+
+/**
+ * Control points of all the edges in the final layout stored in one contiguous buffer.
+ */
+struct flat_paths {
+    std::vector< flat_path > paths;
+    std::vector< vec2 > points;
+
+    std::size_t size() const { return paths.size(); }
+
+    /**
+     * Get the control points of the given edge.
+     */
+    point_span points_of(const flat_path& p) const { return { points.data() + p.offset, p.count }; }
+    point_span points_of(std::size_t i) const { return points_of(paths[i]); }
+};
+
+/**
+ * Algorithm used for assigning the x coordinates of the vertices.
+ */
+enum class positioning_method {
+    balanced, /**< Brandes-Köpf, median of all four alignments */
+    single,   /**< Brandes-Köpf, only one alignment - faster and smaller but leaning to the left */
+};
+
+/**
+ * Shape of the edges in the final layout.
+ */
+enum class routing_method {
+    polyline, /**< straight segments */
+    spline,   /**< piecewise cubic Bézier curves for edges going through several layers */
 };
 
 /**
@@ -35,4 +103,21 @@ struct attributes {
     float layer_dist = 30;       /**< minimum distance between borders of nodes in 2 different layers */
     float loop_angle = 55;       /**< angle determining the point on the node where a loop connects to it */
     float loop_size = node_size; /**< distance which the loop extends from the node*/
+    positioning_method positioning = positioning_method::balanced; /**< algorithm for placing the vertices on layers */
+    routing_method routing = routing_method::polyline; /**< shape of the edges */
+    unsigned routing_threads = 1; /**< number of threads used for routing the edges */
+    bool produce_flat_paths = false; /**< store the control points of all edges in one buffer, see sugiyama_layout::flat_edges() */
+    bool collect_stats = false;  /**< collect statistics about the layout, see sugiyama_layout::stats() */
+};
+
+/**
+ * Hints for laying out a graph, usually taken from a previous layout of a similar graph (see sugiyama_layout::hints()).
+ * Both vectors are indexed by the vertex identifiers and either of them can be empty.
+ */
+struct layout_hints {
+    static constexpr int no_rank = std::numeric_limits<int>::min();
+
+    std::vector<int> ranks;        /**< the preferred layer of each vertex, or no_rank */
+    std::vector<float> order;      /**< the vertices on each layer start ordered by these values, NaN if a vertex has none */
+    std::vector<vertex_t> parents; /**< the parent of each vertex in the spanning tree found by the layering, the vertex itself if it has none */
 };
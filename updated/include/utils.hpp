@@ -47,39 +47,46 @@ struct chain_range {
         It curr;
         It st_end;
         It nd_beg;
+        // the end of one range can be the begin of the other if they are adjacent in memory,
+        // so the iterators are compared only within the same range
+        bool in_first;
 
-        iterator(It curr, It st_end, It nd_beg)
+        iterator(It curr, It st_end, It nd_beg, bool in_first)
             : curr(curr)
             , st_end(st_end)
             , nd_beg(nd_beg) 
+            , in_first(in_first)
         { 
-            if (curr == st_end) {
+            if (in_first && curr == st_end) {
                 this->curr = nd_beg;
+                this->in_first = false;
             }    
         }
 
         typename T::value_type operator*() { return *curr; }
-        friend bool operator==(const iterator& lhs, const iterator& rhs) { return lhs.curr == rhs.curr; }
+        friend bool operator==(const iterator& lhs, const iterator& rhs) { return lhs.in_first == rhs.in_first && lhs.curr == rhs.curr; }
         friend bool operator!=(const iterator& lhs, const iterator& rhs) { return !(lhs == rhs); }
         iterator& operator++() {
-            if (++curr == st_end) {
+            ++curr;
+            if (in_first && curr == st_end) {
                 curr = nd_beg;
+                in_first = false;
             }
             return *this;
         }
     };
 
     iterator begin() {
-        return iterator( std::begin(first), std::end(first), std::begin(second) );
+        return iterator( std::begin(first), std::end(first), std::begin(second), true );
     }
     iterator begin() const {
-        return iterator( std::begin(first), std::end(first), std::begin(second) );
+        return iterator( std::begin(first), std::end(first), std::begin(second), true );
     }
     iterator end() {
-        return iterator( std::end(second),  std::end(first), std::begin(second) );
+        return iterator( std::end(second),  std::end(first), std::begin(second), false );
     }
     iterator end() const {
-        return iterator( std::end(second),  std::end(first), std::begin(second) );
+        return iterator( std::end(second),  std::end(first), std::begin(second), false );
     }
 };
 
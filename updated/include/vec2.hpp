@@ -18,6 +18,8 @@ inline vec2 operator*(T a, vec2 vec) { return { a*vec.x, a*vec.y}; }
 template<typename T>
 inline vec2 operator*(vec2 vec, T a) { return { a*vec.x, a*vec.y}; }
 
+inline vec2 operator/(vec2 vec, float a) { return { vec.x/a, vec.y/a }; }
+
 inline bool operator==(vec2 lhs, vec2 rhs) { return rhs.x == lhs.x && rhs.y == lhs.y; }
 inline bool operator!=(vec2 lhs, vec2 rhs) { return !(lhs == rhs); }
 
@@ -66,6 +68,51 @@ float line_point_dist(vec2 from, vec2 to, vec2 p) {
     return distance(p, x);
 }
 
+/**
+ * Finds the smallest t > t0 for which the line passing through <from> + t*<dir> and <to>
+ * is further than <r> from the point <p>.
+ * Solves (cross(to - a, p - a))^2 = r^2 * |to - a|^2 for a = from + t*dir, which is a quadratic equation in t.
+ * 
+ * @return the parameter t or nullopt if the line never gets far enough
+ */
+inline std::optional<float> line_point_clearance(vec2 from, vec2 dir, vec2 to, vec2 p, float r, float t0) {
+    auto w = to - from;
+    auto m = p - from;
+
+    // the cross product is linear in t, the squared length of the line quadratic
+    double k0 = cross(w, m);
+    double k1 = cross(dir, to - p);
+    double r2 = double(r)*r;
+
+    double a = k1*k1 - r2*dot(dir, dir);
+    double b = 2*k0*k1 + 2*r2*dot(w, dir);
+    double c = k0*k0 - r2*dot(w, w);
+
+    double roots[2];
+    int count = 0;
+    if (std::abs(a) < 1e-9) {
+        if (b == 0) {
+            return std::nullopt;
+        }
+        roots[count++] = -c/b;
+    } else {
+        double discriminant = b*b - 4*a*c;
+        if (discriminant < 0) {
+            return std::nullopt;
+        }
+        discriminant = std::sqrt(discriminant);
+        roots[count++] = std::min( (-b - discriminant)/(2*a), (-b + discriminant)/(2*a) );
+        roots[count++] = std::max( (-b - discriminant)/(2*a), (-b + discriminant)/(2*a) );
+    }
+
+    for (int i = 0; i < count; ++i) {
+        if (roots[i] > t0) {
+            return roots[i];
+        }
+    }
+    return std::nullopt;
+}
+
 // get the first interesection
 std::optional<vec2> line_circle_intersection(vec2 from, vec2 to, vec2 center, float r) {
     auto d = to - from;
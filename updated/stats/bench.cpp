@@ -0,0 +1,285 @@
+#include "interface.hpp"
+#include "svg.hpp"
+#include "parser.hpp"
+#include "helper.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+// every allocation made by the program is counted, so the stages can report how many they make.
+// All the replaceable forms of new and delete are replaced, so every pointer is allocated
+// by malloc or aligned_alloc and released by free.
+std::atomic<uint64_t> allocation_count = 0;
+
+void* counted_alloc(std::size_t size, std::size_t alignment) noexcept {
+	++allocation_count;
+	size = size ? size : 1;
+	if (alignment <= alignof(std::max_align_t)) {
+		return std::malloc(size);
+	}
+	// aligned_alloc needs the size to be a multiple of the alignment
+	return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+void* counted_new(std::size_t size, std::size_t alignment) {
+	if (void* p = counted_alloc(size, alignment)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size) { return counted_new(size, 0); }
+void* operator new[](std::size_t size) { return counted_new(size, 0); }
+void* operator new(std::size_t size, std::align_val_t a) { return counted_new(size, static_cast<std::size_t>(a)); }
+void* operator new[](std::size_t size, std::align_val_t a) { return counted_new(size, static_cast<std::size_t>(a)); }
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return counted_alloc(size, 0); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return counted_alloc(size, 0); }
+void* operator new(std::size_t size, std::align_val_t a, const std::nothrow_t&) noexcept {
+	return counted_alloc(size, static_cast<std::size_t>(a));
+}
+void* operator new[](std::size_t size, std::align_val_t a, const std::nothrow_t&) noexcept {
+	return counted_alloc(size, static_cast<std::size_t>(a));
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
+
+
+// the stages of the layout followed by the whole layout
+constexpr int measure_count = layout_stage_count + 1;
+constexpr int total = layout_stage_count;
+
+const char* measure_name(int i) {
+	return i == total ? "total" : stage_name(static_cast<layout_stage>(i));
+}
+
+/**
+ * Accumulates the time and the number of allocations of each stage over one layout.
+ */
+struct stage_recorder : stage_observer {
+	std::array<decltype(now()), measure_count> started;
+	std::array<uint64_t, measure_count> started_allocs;
+	std::array<double, measure_count> micros{};
+	std::array<uint64_t, measure_count> allocs{};
+
+	void begin(layout_stage s) override { start(static_cast<int>(s)); }
+	void end(layout_stage s) override { stop(static_cast<int>(s)); }
+
+	void start(int i) {
+		started_allocs[i] = allocation_count;
+		started[i] = now();
+	}
+
+	void stop(int i) {
+		auto end = now();
+		micros[i] += std::chrono::duration<double, std::micro>(end - started[i]).count();
+		allocs[i] += allocation_count - started_allocs[i];
+	}
+};
+
+struct samples {
+	std::vector<double> micros;
+	std::vector<double> allocs;
+};
+
+struct summary {
+	double mean;
+	double median;
+	double p90;
+	double p99;
+	double max;
+};
+
+// linear interpolation between the closest ranks
+double percentile(const std::vector<double>& sorted, double q) {
+	double pos = q*(sorted.size() - 1);
+	std::size_t lo = std::floor(pos);
+	std::size_t hi = std::ceil(pos);
+	return sorted[lo] + (sorted[hi] - sorted[lo])*(pos - lo);
+}
+
+summary summarize(std::vector<double> data) {
+	std::sort(data.begin(), data.end());
+	double sum = 0;
+	for (auto x : data) {
+		sum += x;
+	}
+	return { sum/data.size(), percentile(data, 0.5), percentile(data, 0.9), percentile(data, 0.99), data.back() };
+}
+
+struct dataset_result {
+	std::string name;
+	std::size_t graphs;
+	std::array<samples, measure_count> measures;
+};
+
+/**
+ * Lays out every graph in the directory <warmup> times without measuring and then <reps> times with measuring.
+ * Each layout of each graph is one sample.
+ */
+dataset_result run_dataset(const std::string& dir, int warmup, int reps) {
+	std::vector< std::pair<graph, attributes> > inputs;
+	for (const auto& f : dir_contents(dir, ".gv")) {
+		attributes attr;
+		drawing_options opts;
+		graph g = parse(dir + "/" + f, attr, opts);
+		inputs.emplace_back(std::move(g), attr);
+	}
+
+	dataset_result res{ dir, inputs.size(), {} };
+	for (int rep = 0; rep < warmup + reps; ++rep) {
+		for (const auto& [ g, attr ] : inputs) {
+			stage_recorder rec;
+			rec.start(total);
+			{
+				sugiyama_layout l(g, attr, rec);
+			}
+			rec.stop(total);
+
+			if (rep < warmup) {
+				continue;
+			}
+			for (int i = 0; i < measure_count; ++i) {
+				res.measures[i].micros.push_back(rec.micros[i]);
+				res.measures[i].allocs.push_back(rec.allocs[i]);
+			}
+		}
+	}
+	return res;
+}
+
+void write_summary(std::ostream& out, const summary& s) {
+	out << "{ \"mean\": " << s.mean
+		<< ", \"median\": " << s.median
+		<< ", \"p90\": " << s.p90
+		<< ", \"p99\": " << s.p99
+		<< ", \"max\": " << s.max << " }";
+}
+
+void write_json(std::ostream& out, const std::vector<dataset_result>& results, int warmup, int reps) {
+	out << "{\n  \"warmup\": " << warmup << ",\n  \"repetitions\": " << reps << ",\n  \"results\": [";
+	const char* sep = "\n";
+	for (const auto& r : results) {
+		for (int i = 0; i < measure_count; ++i) {
+			out << sep << "    { \"dataset\": \"" << r.name << "\", \"graphs\": " << r.graphs
+				<< ", \"stage\": \"" << measure_name(i) << "\", \"samples\": " << r.measures[i].micros.size() << ",\n";
+			out << "      \"time_us\": ";
+			write_summary(out, summarize(r.measures[i].micros));
+			out << ",\n      \"allocations\": ";
+			write_summary(out, summarize(r.measures[i].allocs));
+			out << " }";
+			sep = ",\n";
+		}
+	}
+	out << "\n  ]\n}\n";
+}
+
+void write_csv(std::ostream& out, const std::vector<dataset_result>& results) {
+	out << "dataset,stage,samples,"
+		<< "time_mean_us,time_median_us,time_p90_us,time_p99_us,time_max_us,"
+		<< "allocs_mean,allocs_median,allocs_p90,allocs_p99,allocs_max\n";
+	for (const auto& r : results) {
+		for (int i = 0; i < measure_count; ++i) {
+			auto t = summarize(r.measures[i].micros);
+			auto a = summarize(r.measures[i].allocs);
+			out << r.name << "," << measure_name(i) << "," << r.measures[i].micros.size() << ","
+				<< t.mean << "," << t.median << "," << t.p90 << "," << t.p99 << "," << t.max << ","
+				<< a.mean << "," << a.median << "," << a.p90 << "," << a.p99 << "," << a.max << "\n";
+		}
+	}
+}
+
+
+std::string usage_string =
+R"(usage: ./bench [-w <warmup>] [-r <repetitions>] [-f json|csv] [-o <file>] [<dir>...]
+
+Measures the time and the number of allocations of each stage of the layout
+for all .gv files in the given directories (data/20 data/50 data/100 data/150 by default).
+    -w Number of unmeasured runs over each directory before the measurement (1 by default).
+    -r Number of measured runs over each directory (5 by default).
+    -f Format of the results (json by default).
+    -o Write the results to <file> instead of the standard output.
+
+Each layout of a graph is one sample. For each directory and stage the mean, median, 90th and 99th percentile
+and the maximum over all the samples are reported.
+)";
+
+void print_help() {
+	std::cout << usage_string;
+}
+
+int main(int argc, char **argv) {
+	int warmup = 1;
+	int reps = 5;
+	std::string format = "json";
+	std::string out_file;
+	std::vector<std::string> dirs;
+
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "-h") {
+			print_help();
+			return 0;
+		} else if (arg == "-w" && i + 1 < argc) {
+			warmup = std::max(0, std::atoi(argv[++i]));
+		} else if (arg == "-r" && i + 1 < argc) {
+			reps = std::max(1, std::atoi(argv[++i]));
+		} else if (arg == "-f" && i + 1 < argc) {
+			format = argv[++i];
+		} else if (arg == "-o" && i + 1 < argc) {
+			out_file = argv[++i];
+		} else if (arg[0] == '-') {
+			print_help();
+			return 1;
+		} else {
+			dirs.push_back(arg);
+		}
+	}
+	if (format != "json" && format != "csv") {
+		print_help();
+		return 1;
+	}
+	if (dirs.empty()) {
+		dirs = { "data/20", "data/50", "data/100", "data/150" };
+	}
+
+	std::vector<dataset_result> results;
+	for (const auto& dir : dirs) {
+		results.push_back(run_dataset(dir, warmup, reps));
+		if (results.back().graphs == 0) {
+			std::cerr << "no .gv files in " << dir << "\n";
+			return 1;
+		}
+	}
+
+	std::ofstream file;
+	if (!out_file.empty()) {
+		file.open(out_file);
+	}
+	std::ostream& out = out_file.empty() ? std::cout : file;
+	if (format == "json") {
+		write_json(out, results, warmup, reps);
+	} else {
+		write_csv(out, results);
+	}
+	return 0;
+}
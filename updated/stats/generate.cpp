@@ -0,0 +1,307 @@
+#include "graph.hpp"
+#include "svg.hpp"
+#include "binary.hpp"
+#include "parser.hpp"
+#include "helper.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+using edge_list = std::vector< std::pair<vertex_t, vertex_t> >;
+
+/**
+ * All the generators produce edges going from a lower to a higher vertex identifier
+ * (the call graph from a higher to a lower one), so the graphs are acyclic
+ * until some of the edges are reversed by add_cycles.
+ *
+ * Only the raw output of std::mt19937_64 is used, since it is the same everywhere,
+ * unlike the standard distributions, so a seed produces the same graph on every platform.
+ */
+struct generator {
+	std::mt19937_64 rng;
+
+	// uniformly random number in [0, n)
+	uint64_t uniform(uint64_t n) { return rng() % n; }
+
+	// uniformly random number in [0, 1)
+	double chance() { return (rng() >> 11) * 0x1.0p-53; }
+
+	// number of edges leaving a vertex, so that the average is <degree>
+	unsigned out_degree(double degree) {
+		unsigned base = degree;
+		return base + (chance() < degree - base ? 1 : 0);
+	}
+
+	/**
+	 * Vertices split into <layers> layers of similar size with edges going mostly to the next layer.
+	 * One in ten edges skips one or more layers.
+	 */
+	edge_list layered(unsigned n, double degree, unsigned layers) {
+		layers = std::clamp(layers, 1u, n);
+		auto layer_start = [n, layers] (unsigned l) { return static_cast<vertex_t>( (uint64_t(n)*l)/layers ); };
+
+		edge_list edges;
+		edges.reserve(n*degree);
+		for (unsigned l = 0; l + 1 < layers; ++l) {
+			for (vertex_t u = layer_start(l); u < layer_start(l + 1); ++u) {
+				for (unsigned k = out_degree(degree); k > 0; --k) {
+					unsigned target = l + 1;
+					while (target + 1 < layers && chance() < 0.1) {
+						++target;
+					}
+					vertex_t from = layer_start(target);
+					edges.emplace_back(u, from + uniform(layer_start(target + 1) - from));
+				}
+			}
+		}
+		return edges;
+	}
+
+	/**
+	 * Edges between uniformly random pairs of distinct vertices.
+	 */
+	edge_list random(unsigned n, double degree) {
+		edge_list edges;
+		uint64_t m = n*degree;
+		edges.reserve(m);
+		while (n > 1 && edges.size() < m) {
+			vertex_t u = uniform(n);
+			vertex_t v = uniform(n);
+			if (u != v) {
+				edges.emplace_back(std::min(u, v), std::max(u, v));
+			}
+		}
+		return edges;
+	}
+
+	/**
+	 * Each new function calls several of the already existing ones,
+	 * chosen with probability proportional to the number of their callers plus one.
+	 * This gives the power-law distribution of in-degrees typical for call graphs.
+	 */
+	edge_list call_graph(unsigned n, double degree) {
+		edge_list edges;
+		edges.reserve(n*degree);
+		std::vector<vertex_t> weighted; // each vertex appears once plus once for each of its callers
+		weighted.reserve(n + n*degree);
+		for (vertex_t u = 0; u < n; ++u) {
+			if (u > 0) {
+				for (unsigned k = out_degree(degree); k > 0; --k) {
+					vertex_t v = weighted[ uniform(weighted.size()) ];
+					edges.emplace_back(u, v);
+					weighted.push_back(v);
+				}
+			}
+			weighted.push_back(u);
+		}
+		return edges;
+	}
+
+	edge_list chain(unsigned n) {
+		edge_list edges;
+		edges.reserve(n);
+		for (vertex_t u = 0; u + 1 < n; ++u) {
+			edges.emplace_back(u, u + 1);
+		}
+		return edges;
+	}
+
+	/**
+	 * Reverses each edge with probability <ratio>.
+	 */
+	void add_cycles(edge_list& edges, double ratio) {
+		if (ratio <= 0) {
+			return;
+		}
+		for (auto& [ u, v ] : edges) {
+			if (chance() < ratio) {
+				std::swap(u, v);
+			}
+		}
+	}
+};
+
+// removes parallel edges and loops
+void remove_duplicates(edge_list& edges) {
+	std::sort(edges.begin(), edges.end());
+	edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+	edges.erase(std::remove_if(edges.begin(), edges.end(), [] (const auto& e) { return e.first == e.second; }), edges.end());
+}
+
+// the names start with a letter, since the line based parse() skips lines starting with anything else
+void write_dot(unsigned n, const edge_list& edges, const std::string& file) {
+	std::ofstream out { file, std::ios::binary };
+	std::string buffer;
+	buffer.reserve(1 << 17);
+	auto put = [&buffer] (vertex_t u) {
+		buffer += 'n';
+		char digits[16];
+		auto end = std::to_chars(digits, digits + sizeof(digits), u).ptr;
+		buffer.append(digits, end);
+	};
+	auto flush = [&] (bool force) {
+		if (force || buffer.size() >= (1 << 16)) {
+			out.write(buffer.data(), buffer.size());
+			buffer.clear();
+		}
+	};
+
+	buffer += "digraph G{\n";
+	// vertices without edges would otherwise be lost
+	std::vector<bool> used(n, false);
+	for (auto [ u, v ] : edges) {
+		used[u] = used[v] = true;
+	}
+	for (vertex_t u = 0; u < n; ++u) {
+		if (!used[u]) {
+			put(u);
+			buffer += "\n";
+			flush(false);
+		}
+	}
+	for (auto [ u, v ] : edges) {
+		put(u);
+		buffer += " -> ";
+		put(v);
+		buffer += "\n";
+		flush(false);
+	}
+	buffer += "}\n";
+	flush(true);
+}
+
+void write_binary(unsigned n, const edge_list& edges, const std::string& file) {
+	graph g(n, edges);
+
+	// the labels are the names used in the .gv output, stored in one string
+	std::string names;
+	std::vector<std::size_t> ends;
+	for (vertex_t u = 0; u < n; ++u) {
+		names += "n" + std::to_string(u);
+		ends.push_back(names.size());
+	}
+	drawing_options opts;
+	opts.label_views.reserve(n);
+	for (vertex_t u = 0; u < n; ++u) {
+		std::size_t begin = u == 0 ? 0 : ends[u - 1];
+		opts.label_views.emplace_back(names.data() + begin, ends[u] - begin);
+	}
+
+	save_binary(file, g, attributes{}, opts);
+}
+
+// reads the written file back and checks that it contains the whole graph
+bool check_written(unsigned n, const edge_list& edges, const std::string& file) {
+	if (ends_with(file, ".bin")) {
+		binary_graph b(file);
+		return b.size() == n && b.edge_count() == edges.size();
+	}
+
+	attributes attr;
+	drawing_options opts;
+	graph g = parse(file, attr, opts);
+	std::size_t edge_count = 0;
+	for (auto u : g.vertices()) {
+		edge_count += g.out_neighbours(u).size();
+	}
+	return g.size() == n && edge_count == edges.size();
+}
+
+
+std::string usage_string =
+R"(usage: ./gen [-k <kind>] [-n <vertices>] [-d <degree>] [-l <layers>] [-c <ratio>] [-s <seed>] <output>
+
+Generates a random graph and writes it to <output> as a .gv file, or in the binary format if it ends with .bin.
+    -k The kind of the graph (layered by default):
+         layered   vertices in layers with edges mostly between consecutive layers
+         random    edges between uniformly random pairs of vertices
+         callgraph calls to existing functions with a power-law distribution of callers
+         chain     one long path
+    -n Number of vertices (1000 by default).
+    -d Average number of edges leaving a vertex (2 by default), not used for chain.
+    -l Number of layers of the layered graph (square root of the number of vertices by default).
+    -c Fraction of edges reversed to create cycles (0 by default).
+    -s Seed of the random number generator (1 by default).
+
+Parallel edges and loops are removed, so the graph may have slightly fewer edges.
+The written file is read back to check that it contains the whole graph.
+)";
+
+void print_help() {
+	std::cout << usage_string;
+}
+
+int main(int argc, char **argv) {
+	std::string kind = "layered";
+	unsigned n = 1000;
+	double degree = 2;
+	unsigned layers = 0;
+	double cycle_ratio = 0;
+	uint64_t seed = 1;
+	std::string out;
+
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		bool has_value = i + 1 < argc;
+		if (arg == "-h") {
+			print_help();
+			return 0;
+		} else if (arg == "-k" && has_value) {
+			kind = argv[++i];
+		} else if (arg == "-n" && has_value) {
+			n = std::strtoul(argv[++i], nullptr, 10);
+		} else if (arg == "-d" && has_value) {
+			degree = std::atof(argv[++i]);
+		} else if (arg == "-l" && has_value) {
+			layers = std::strtoul(argv[++i], nullptr, 10);
+		} else if (arg == "-c" && has_value) {
+			cycle_ratio = std::atof(argv[++i]);
+		} else if (arg == "-s" && has_value) {
+			seed = std::strtoull(argv[++i], nullptr, 10);
+		} else if (arg[0] != '-' && out.empty()) {
+			out = arg;
+		} else {
+			print_help();
+			return 1;
+		}
+	}
+	if (out.empty() || n == 0 || degree < 0) {
+		print_help();
+		return 1;
+	}
+
+	generator gen{ std::mt19937_64(seed) };
+	edge_list edges;
+	if (kind == "layered") {
+		edges = gen.layered(n, degree, layers ? layers : std::max(1u, static_cast<unsigned>(std::sqrt(n))));
+	} else if (kind == "random") {
+		edges = gen.random(n, degree);
+	} else if (kind == "callgraph") {
+		edges = gen.call_graph(n, degree);
+	} else if (kind == "chain") {
+		edges = gen.chain(n);
+	} else {
+		print_help();
+		return 1;
+	}
+	gen.add_cycles(edges, cycle_ratio);
+	remove_duplicates(edges);
+
+	if (ends_with(out, ".bin")) {
+		write_binary(n, edges, out);
+	} else {
+		write_dot(n, edges, out);
+	}
+	if (!check_written(n, edges, out)) {
+		std::cerr << "'" << out << "' does not load back as the generated graph.\n";
+		return 1;
+	}
+	return 0;
+}
@@ -2,7 +2,14 @@
 #include "svg.hpp"
 #include "parser.hpp"
 #include "helper.hpp"
-
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <memory>
+#include <thread>
 #include <tuple>
 #include <fstream>
 #include <string>
@@ -38,17 +45,6 @@ bool segments_intersect(vec2 p1, vec2 p2, vec2 q1, vec2 q2) {
 	return (t > 0) && (t <= 1) && (u > 0) && (u <= 1);
 }
 
-int polyline_crossings(const std::vector<vec2>& l1, const std::vector<vec2>& l2) {
-	int total = 0;
-	for (int i = 1; i < l1.size(); ++i) {
-		for (int j = 1; j < l2.size(); ++j) {
-			if (segments_intersect(l1[i-1], l1[i], l2[j-1], l2[j]))
-				++total;
-		}
-	}
-	return total;
-}
-
 auto parse_plain_dot(const std::string& file)
 	-> std::tuple< std::vector<node>, std::vector<path>, vec2 > 
 {
@@ -105,7 +101,7 @@ float get_total_bends(const std::vector<path>& paths) {
 	float total = 0;
 	for (const auto& p : paths) {
 		vec2 prev { 0, 0};
-		for (int i = 1; i < p.points.size(); ++i) {
+		for (std::size_t i = 1; i < p.points.size(); ++i) {
 			auto v = p.points[i] - p.points[i-1];
 			// are they not collinear?
 			if (cross(prev, v) != 0) {
@@ -120,7 +116,7 @@ float get_total_bends(const std::vector<path>& paths) {
 float get_total_length(const std::vector<path>& paths) {
 	float total = 0;
 	for (const auto& p : paths) {
-		for (int i = 1; i < p.points.size(); ++i) {
+		for (std::size_t i = 1; i < p.points.size(); ++i) {
 			total += distance(p.points[i], p.points[i-1]);
 		}
 	}
@@ -136,11 +132,81 @@ float get_total_reversed(const std::vector<path>& paths) {
 	return total;
 }
 
+struct segment {
+	vec2 from, to;
+	int path;    // index of the path the segment belongs to
+	float min_x, max_x;
+};
+
+/**
+ * Counts the crossings between segments of different paths, with the same result as testing every pair.
+ * 
+ * The drawing is cut into horizontal bands about as high as an average segment, so most segments
+ * fall into one or two bands. Only segments sharing a band can intersect and each pair is tested only
+ * in the first band they share. Within a band the segments are swept from left to right, 
+ * so only the pairs whose x ranges overlap are tested.
+ */
 int get_total_cross(const std::vector<path>& paths, const std::vector<node>& nodes) {
+	std::vector<segment> segments;
+	float min_y = std::numeric_limits<float>::max();
+	float max_y = std::numeric_limits<float>::lowest();
+	float total_height = 0;
+	for (int p = 0; p < static_cast<int>(paths.size()); ++p) {
+		const auto& points = paths[p].points;
+		for (std::size_t i = 1; i < points.size(); ++i) {
+			segments.push_back({ points[i - 1], points[i], p, 
+								 std::min(points[i - 1].x, points[i].x), std::max(points[i - 1].x, points[i].x) });
+			min_y = std::min({ min_y, points[i - 1].y, points[i].y });
+			max_y = std::max({ max_y, points[i - 1].y, points[i].y });
+			total_height += std::abs(points[i].y - points[i - 1].y);
+		}
+	}
+	if (segments.empty()) {
+		return 0;
+	}
+
+	float band_height = std::max(total_height / segments.size(), (max_y - min_y) / segments.size());
+	int band_count = 1;
+	if (band_height > 0) {
+		band_count = std::min<float>(segments.size(), std::floor((max_y - min_y) / band_height) + 1);
+	}
+	auto band = [&] (float y) {
+		if (band_count == 1) return 0;
+		return std::min(band_count - 1, static_cast<int>((y - min_y) / band_height));
+	};
+
+	std::vector<int> first_band(segments.size());
+	std::vector< std::vector<int> > bands(band_count);
+	for (int i = 0; i < static_cast<int>(segments.size()); ++i) {
+		int lo = band(std::min(segments[i].from.y, segments[i].to.y));
+		int hi = band(std::max(segments[i].from.y, segments[i].to.y));
+		first_band[i] = lo;
+		for (int b = lo; b <= hi; ++b) {
+			bands[b].push_back(i);
+		}
+	}
+
 	int total = 0;
-	for(int p = 0; p < paths.size(); ++p) {
-		for(int q = p + 1; q < paths.size(); ++q) {
-			total += polyline_crossings(paths[p].points, paths[q].points);
+	for (int b = 0; b < band_count; ++b) {
+		auto& members = bands[b];
+		std::sort(members.begin(), members.end(), [&segments] (int i, int j) {
+			return segments[i].min_x < segments[j].min_x;
+		});
+
+		for (std::size_t k = 0; k < members.size(); ++k) {
+			const auto& s = segments[ members[k] ];
+			for (std::size_t l = k + 1; l < members.size() && segments[ members[l] ].min_x <= s.max_x; ++l) {
+				const auto& t = segments[ members[l] ];
+				if (s.path == t.path || std::max(first_band[ members[k] ], first_band[ members[l] ]) != b) {
+					continue;
+				}
+				// test in the same order as the pairs of paths are enumerated
+				bool crossed = s.path < t.path ? segments_intersect(s.from, s.to, t.from, t.to)
+											   : segments_intersect(t.from, t.to, s.from, s.to);
+				if (crossed) {
+					++total;
+				}
+			}
 		}
 	}
 	return total;
@@ -160,6 +226,7 @@ std::string print(int i) {
 			return "bend";
 	}
 	assert(false);
+	return "";
 }
 
 struct stats {
@@ -197,35 +264,214 @@ std::tuple<float, float, float> quartiles(const std::vector<float>& data) {
 	return { low, med, up };
 }
 
-void print(int i, const std::vector<float>& data) {
-	std::cout << print(i) << ":";
-	for (auto x : data) {
-		std::cout << " " << x;
-	}
-	std::cout << "\n";
-}
+using metrics = std::array<float, 4>;
 
-void count_stuff(const std::vector<path>& paths, const std::vector<node>& nodes, std::array<std::vector<float>, 4>& props) {
-	props[cros].push_back( get_total_cross(paths, nodes) );
-	props[len].push_back( get_total_length(paths) );
-	props[rev].push_back( get_total_reversed(paths) );
-	props[bend].push_back( get_total_bends(paths) );
+metrics measure(const std::vector<path>& paths, const std::vector<node>& nodes) {
+	metrics m;
+	m[cros] = get_total_cross(paths, nodes);
+	m[len] = get_total_length(paths);
+	m[rev] = get_total_reversed(paths);
+	m[bend] = get_total_bends(paths);
+	return m;
 }
 
-std::array< stats, 4 > get_stats(std::array<std::vector<float>, 4>& props) {
-	std::array< stats, 4 > res;
+/**
+ * Collects the measurements of all the files and computes their statistics.
+ */
+struct aggregator {
+	virtual void add(const metrics& m) = 0;
+	virtual std::array< stats, 4 > get_stats() = 0;
+	virtual ~aggregator() = default;
+};
 
-	for (int i = 0; i < 4; ++i) {
-		auto& data = props[i];
-		std::sort(data.begin(), data.end());
+/**
+ * Keeps every measurement and computes the exact quartiles.
+ */
+class exact_aggregator : public aggregator {
+	std::array<std::vector<float>, 4> props;
+
+public:
+	void add(const metrics& m) override {
+		for (int i = 0; i < 4; ++i) {
+			props[i].push_back(m[i]);
+		}
+	}
 
-		res[i].min = data.front();
-		res[i].max = data.back();
-		std::tie(res[i].lower, res[i].median, res[i].upper) = quartiles(data);
+	std::array< stats, 4 > get_stats() override {
+		std::array< stats, 4 > res;
+		for (int i = 0; i < 4; ++i) {
+			auto& data = props[i];
+			std::sort(data.begin(), data.end());
 
-		std::cout << print(i) << ": " << res[i] << "\n";
+			res[i].min = data.front();
+			res[i].max = data.back();
+			std::tie(res[i].lower, res[i].median, res[i].upper) = quartiles(data);
+		}
+		return res;
+	}
+};
+
+/**
+ * Streaming quantile sketch for non-negative values with bounded relative error.
+ *
+ * Values are counted in buckets whose bounds grow geometrically, so the memory depends only on
+ * the range of the values and not on their number. Any quantile is within <accuracy> of the exact one
+ * relative to its value. The minimum and maximum are exact.
+ */
+class quantile_sketch {
+	double gamma;
+	double log_gamma;
+	std::map<int, uint64_t> buckets; // bucket i counts the values in (gamma^(i-1), gamma^i]
+	uint64_t zeros = 0;
+	uint64_t count = 0;
+	float min = std::numeric_limits<float>::max();
+	float max = std::numeric_limits<float>::lowest();
+
+public:
+	explicit quantile_sketch(double accuracy = 0.01)
+		: gamma((1 + accuracy)/(1 - accuracy))
+		, log_gamma(std::log(gamma)) {}
+
+	void add(float x) {
+		++count;
+		min = std::min(min, x);
+		max = std::max(max, x);
+		if (x <= 0) {
+			++zeros;
+		} else {
+			++buckets[ static_cast<int>(std::ceil(std::log(x)/log_gamma)) ];
+		}
+	}
+
+	float quantile(double q) const {
+		uint64_t rank = q*(count - 1);
+		if (rank < zeros) {
+			return std::max(0.0f, min);
+		}
+		uint64_t seen = zeros;
+		for (auto [ i, n ] : buckets) {
+			seen += n;
+			if (seen > rank) {
+				// the middle of the bucket in the relative sense
+				float estimate = 2*std::pow(gamma, i)/(gamma + 1);
+				return std::clamp(estimate, min, max);
+			}
+		}
+		return max;
+	}
+
+	float minimum() const { return min; }
+	float maximum() const { return max; }
+};
+
+class sketch_aggregator : public aggregator {
+	std::array<quantile_sketch, 4> sketches;
+
+public:
+	void add(const metrics& m) override {
+		for (int i = 0; i < 4; ++i) {
+			sketches[i].add(m[i]);
+		}
+	}
+
+	std::array< stats, 4 > get_stats() override {
+		std::array< stats, 4 > res;
+		for (int i = 0; i < 4; ++i) {
+			const auto& s = sketches[i];
+			res[i] = { s.minimum(), s.maximum(), s.quantile(0.5), s.quantile(0.75), s.quantile(0.25) };
+		}
+		return res;
+	}
+};
+
+/**
+ * Writes the measurements of each file as a row of a CSV file, or as an object in a JSON array 
+ * if the file name ends with .json.
+ */
+class row_writer {
+	std::ofstream out;
+	bool json;
+	const char* sep = "\n";
+
+public:
+	explicit row_writer(const std::string& file) : out(file), json(ends_with(file, ".json")) {
+		if (json) {
+			out << "[";
+		} else {
+			out << "set,file";
+			for (int i = 0; i < 4; ++i) {
+				out << "," << print(i);
+			}
+			out << "\n";
+		}
+	}
+
+	~row_writer() {
+		if (json) {
+			out << "\n]\n";
+		}
+	}
+
+	void write(const std::string& set, const std::string& file, const metrics& m) {
+		if (json) {
+			out << sep << "  { \"set\": \"" << set << "\", \"file\": \"" << file << "\"";
+			for (int i = 0; i < 4; ++i) {
+				out << ", \"" << print(i) << "\": " << m[i];
+			}
+			out << " }";
+			sep = ",\n";
+		} else {
+			out << set << "," << file;
+			for (int i = 0; i < 4; ++i) {
+				out << "," << m[i];
+			}
+			out << "\n";
+		}
+	}
+};
+
+struct options {
+	unsigned threads = 1;
+	bool sketch = false;
+	std::unique_ptr<row_writer> rows;
+};
+
+/**
+ * Measures all the files using <threads> threads.
+ * The files are processed in batches, so only the measurements of one batch are kept at a time,
+ * and the results are added in the order of the files, so the output does not depend on the number of threads.
+ */
+template<typename F>
+std::array< stats, 4 > measure_files(const std::string& in, const std::vector<std::string>& files, 
+									 const std::string& set, options& opts, F measure_file) 
+{
+	std::unique_ptr<aggregator> agg;
+	if (opts.sketch) {
+		agg = std::make_unique<sketch_aggregator>();
+	} else {
+		agg = std::make_unique<exact_aggregator>();
 	}
 
+	constexpr std::size_t batch_size = 1024;
+	std::vector<metrics> batch;
+	for (std::size_t start = 0; start < files.size(); start += batch_size) {
+		batch.resize( std::min(batch_size, files.size() - start) );
+		detail::parallel_for(batch.size(), opts.threads, [&] (std::size_t i) {
+			batch[i] = measure_file(in + "/" + files[start + i]);
+		});
+
+		for (std::size_t i = 0; i < batch.size(); ++i) {
+			agg->add(batch[i]);
+			if (opts.rows) {
+				opts.rows->write(set, files[start + i], batch[i]);
+			}
+		}
+	}
+
+	auto res = agg->get_stats();
+	for (int i = 0; i < 4; ++i) {
+		std::cout << print(i) << ": " << res[i] << "\n";
+	}
 	return res;
 }
 
@@ -242,49 +488,45 @@ void write_stats(const std::array< stats, 4 >& s, const std::string& path, const
 	out << "\n";
 }
 
-void do_dot_stat(const std::string& in, const std::string& log) {
-	std::array<std::vector<float>, 4> props;
-
+void do_dot_stat(const std::string& in, const std::string& log, options& opts) {
 	auto files = dir_contents(in, ".plain");
 	if (files.empty()) {
 		return;
 	}
-	for (const auto& f : files) {
-		auto [ nodes, paths, dims ] = parse_plain_dot( in + "/" + f );
-		count_stuff(paths, nodes, props);
-	}
 
-	auto stats = get_stats(props);
+	auto stats = measure_files(in, files, in + " DOT", opts, [] (const std::string& file) {
+		auto [ nodes, paths, dims ] = parse_plain_dot(file);
+		return measure(paths, nodes);
+	});
 	write_stats(stats, log, in + " DOT");
 }
 
-void do_my_stat(const std::string& in, const std::string& log) {
-	std::array<std::vector<float>, 4> props;
-
+void do_my_stat(const std::string& in, const std::string& log, options& opts) {
 	auto files = dir_contents(in, ".gv");
 	if (files.empty()) {
 		return;
 	}
-	for (const auto& f : files) {
+
+	auto stats = measure_files(in, files, in + " ME", opts, [] (const std::string& file) {
 		attributes attr;
 		drawing_options opt;
-		graph g = parse(in + "/" + f, attr, opt);
+		graph g = parse(file, attr, opt);
 		sugiyama_layout l(g, attr);
-
-		count_stuff(l.edges(), l.vertices(), props);
-	}
-
-	auto stats = get_stats(props);
+		return measure(l.edges(), l.vertices());
+	});
 	write_stats(stats, log, in + " ME");
 }
 
 
 std::string usage_string =
-R"(usage: ./stats <source_dir> <log_file>
-       ./stats --dot <source_dir> <log_file>
+R"(usage: ./stats [-j <threads>] [--sketch] [--rows <file>] <source_dir> <log_file>
+       ./stats [-j <threads>] [--sketch] [--rows <file>] --dot <source_dir> <log_file>
 
 Takes all .gv files in <source_dir> and appends statistics about drawings produced by the library to <log_file>.
 If --dot is given the statistics are compiled from all .plain files which should contain dot output with -Tplain option.
+    -j       Number of files processed at once (all hardware threads by default).
+    --sketch Estimate the quartiles with a streaming sketch within 1% instead of keeping every measurement.
+    --rows   Also write the measurements of each file to <file>, as JSON if it ends with .json and as CSV otherwise.
 )";
 
 void print_help() {
@@ -293,15 +535,36 @@ void print_help() {
 
 
 int main(int argc, char **argv) {
-	if (argc == 4 && std::string{argv[1]} == "--dot") {
-		do_dot_stat(argv[2], argv[3]);
-	} else if (argc == 3) {
-		do_my_stat(argv[1], argv[2]);
-	} else if (argc == 2 && std::string{argv[1]} == "-h") {
-		print_help();
-		return 0;
-	} else {
+	options opts;
+	opts.threads = std::max(1u, std::thread::hardware_concurrency());
+	bool dot = false;
+	std::vector<std::string> args;
+
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "-h") {
+			print_help();
+			return 0;
+		} else if (arg == "-j" && i + 1 < argc) {
+			opts.threads = std::max(1, std::atoi(argv[++i]));
+		} else if (arg == "--sketch") {
+			opts.sketch = true;
+		} else if (arg == "--rows" && i + 1 < argc) {
+			opts.rows = std::make_unique<row_writer>(argv[++i]);
+		} else if (arg == "--dot") {
+			dot = true;
+		} else {
+			args.push_back(arg);
+		}
+	}
+	if (args.size() != 2) {
 		print_help();
 		return 1;
 	}
-}
\ No newline at end of file
+
+	if (dot) {
+		do_dot_stat(args[0], args[1], opts);
+	} else {
+		do_my_stat(args[0], args[1], opts);
+	}
+}
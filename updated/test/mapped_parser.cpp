@@ -0,0 +1,81 @@
+#include "mapped_parser.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// lines of single edges around a statement spanning many lines in the middle of the body,
+// so the parts read by parse_mapped_parallel() would be split inside of it at a plain line break
+std::string multiline_graph() {
+	std::string edges;
+	for (int i = 0; edges.size() < (3 << 20) / 2; ++i) {
+		edges += "n" + std::to_string(i) + " -> n" + std::to_string(i + 1) + "\n";
+	}
+
+	std::string statement = "s [\n";
+	for (int i = 0; i < 2000; ++i) {
+		statement += "  x" + std::to_string(i) + "=\"line\nbreak\",\n";
+	}
+	statement += "  label=\"a\n-> b\"\n]\n";
+	statement += "s ->\n";
+	for (int i = 0; i < 2000; ++i) {
+		statement += "  t" + std::to_string(i) + " ->\n";
+	}
+	statement += "  n0\n";
+	statement += "subgraph sg\n{\n";
+	for (int i = 0; i < 2000; ++i) {
+		statement += "  u" + std::to_string(i) + "\n";
+	}
+	statement += "} -> s\n";
+
+	return "digraph g {\n" + edges + statement + edges + "}\n";
+}
+
+int check(bool ok, const char* what) {
+	if (!ok) {
+		std::cerr << "FAILED: " << what << "\n";
+	}
+	return ok ? 0 : 1;
+}
+
+// a graph whose vertices are named like the keywords of the language
+const char* quoted_keywords_graph = R"(digraph {
+	"node" -> "graph"
+	"edge" -> "subgraph" -> <strict>
+	node [ label = "x" ]
+}
+)";
+
+int main() {
+	std::string path = "mapped_parser_test.gv";
+	std::ofstream(path) << multiline_graph();
+
+	attributes attr;
+	drawing_options serial_opts, parallel_opts;
+	auto serial = parse_mapped(path, attr, serial_opts);
+	std::size_t parts = 0;
+	auto parallel = parse_mapped_parallel(path, attr, parallel_opts, 4, &parts);
+
+	int failed = 0;
+	// without it a broken split would fall back to parse_mapped() and compare it with itself
+	failed += check(parts > 1, "the file is read in parts");
+	failed += check(serial.g.size() == parallel.g.size(), "number of vertices");
+	bool same_edges = true;
+	for (auto u : serial.g.vertices()) {
+		same_edges = same_edges && u < parallel.g.size() && serial.g.out_neighbours(u) == parallel.g.out_neighbours(u);
+	}
+	failed += check(same_edges, "edges");
+	failed += check(serial_opts.label_views == parallel_opts.label_views, "labels");
+
+	std::ofstream(path) << quoted_keywords_graph;
+	drawing_options opts;
+	auto quoted = parse_mapped(path, attr, opts);
+	std::vector<std::string_view> names = { "graph", "node", "subgraph", "edge", "strict" };
+	failed += check(quoted.g.size() == 5 && opts.label_views == names, "quoted keywords as identifiers");
+	failed += check(quoted.g.out_neighbours(1) == std::pmr::vector<vertex_t>{ 0 } &&
+					quoted.g.out_neighbours(2) == std::pmr::vector<vertex_t>{ 4 }, "edges between quoted keywords");
+
+	std::remove(path.c_str());
+	return failed;
+}
@@ -0,0 +1,40 @@
+#include "raster.hpp"
+
+#include <iostream>
+
+int check(bool ok, const char* what) {
+	if (!ok) {
+		std::cerr << "FAILED: " << what << "\n";
+	}
+	return ok ? 0 : 1;
+}
+
+bool background(const raster_image& img, unsigned x, unsigned y) {
+	const uint8_t* px = img.row(y) + 4*x;
+	return px[0] == 255 && px[1] == 255 && px[2] == 255;
+}
+
+int main() {
+	int failed = 0;
+
+	// pixels within the padding of the shapes, but past the endpoints of the segments
+	rasterizer horizontal({ 60, 20 }, 0);
+	horizontal.draw_line({ 10, 10 }, { 50, 10 });
+	auto img = horizontal.render();
+	failed += check(!background(img, 30, 9), "pixel on a segment");
+	failed += check(background(img, 51, 9), "pixel past the end of a horizontal segment");
+	failed += check(background(img, 8, 9), "pixel before the start of a horizontal segment");
+
+	rasterizer diagonal({ 40, 40 }, 0);
+	diagonal.draw_line({ 10, 10 }, { 30, 30 });
+	img = diagonal.render();
+	failed += check(background(img, 31, 31), "pixel past the end of a diagonal segment");
+
+	rasterizer triangle({ 40, 30 }, 0);
+	triangle.draw_triangle({ 10, 10 }, { 30, 10 }, { 20, 20 });
+	img = triangle.render();
+	failed += check(!background(img, 20, 12), "pixel inside of a triangle");
+	failed += check(background(img, 31, 9), "pixel past a vertex of a triangle");
+
+	return failed;
+}